@@ -1,16 +1,24 @@
 set -eu
 
-gsutil cp ${GCS_SOURCE_FILE_PATH} ${CONTAINER_SOURCE_FILE_PATH}
+# gs:// で始まらないパスはローカルのディレクトリとして扱う
+# (python_scripts/run_shards.py がクラウドを使わずにこのスクリプトを動かす)
+copy() {
+    case "$1 $2" in
+        *gs://*) gsutil -m cp "$1" "$2" ;;
+        # 入力の * はここで展開させる
+        *) cp $1 "$2" ;;
+    esac
+}
+
+copy ${GCS_SOURCE_FILE_PATH} ${CONTAINER_SOURCE_FILE_PATH}
 eval "$BUILD_COMMAND"
 
 mkdir -p input
 mkdir -p output
-gsutil -m cp "${GCS_INPUT_DIR_PATH}/${CLOUD_RUN_TASK_INDEX}/*" input/
+copy "${GCS_INPUT_DIR_PATH}/${CLOUD_RUN_TASK_INDEX}/*" input/
 
-for f in $(ls input/)
-do
-    echo $f
-    ./tester ./a.out < input/$f 2> output/$f
-done
+# このタスクに割り当てられたケースを PARALLELISM 個ずつ並行に走らせる
+ls input/ | xargs -P "${PARALLELISM:-$(nproc)}" -I{} \
+    sh -c 'echo {}; ./tester ./a.out < input/{} 2> output/{}'
 
-gsutil -m cp output/* ${GCS_OUTPUT_DIR_PATH}/
+copy "output/*" ${GCS_OUTPUT_DIR_PATH}/
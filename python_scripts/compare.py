@@ -0,0 +1,195 @@
+import argparse
+from concurrent.futures import FIRST_COMPLETED, ThreadPoolExecutor, wait
+import math
+from pathlib import Path
+from typing import Optional
+
+import run_local
+
+REPO_ROOT = Path(__file__).resolve().parent.parent
+TESTER = "./official_tools/target/release/tester"
+
+
+class PairedSPRT:
+    """同じ seed での log2(スコア) の差 d = B - A の平均 mu についての逐次検定
+
+    「mu = +delta 対 mu = 0」と「mu = -delta 対 mu = 0」の 2 つの
+    逐次確率比検定 (SPRT) を同時に行う。d は正規分布とみなし,
+    分散はそれまでの標本分散で置き換える。
+    どちらかで対立仮説を採れば better / worse, 両方で帰無仮説を採れば
+    |mu| < delta とみなして same とする。
+    """
+
+    def __init__(self, delta: float, alpha: float, beta: float, min_samples: int):
+        self.delta = delta
+        self.min_samples = min_samples
+        # 対数尤度比がこれを超えたら対立仮説, 下回ったら帰無仮説を採る
+        self.upper = math.log((1 - beta) / alpha)
+        self.lower = math.log(beta / (1 - alpha))
+        self.diffs: list[float] = []
+
+    def add(self, diff: float):
+        self.diffs.append(diff)
+
+    @property
+    def n(self) -> int:
+        return len(self.diffs)
+
+    @property
+    def mean(self) -> float:
+        return sum(self.diffs) / max(self.n, 1)
+
+    @property
+    def variance(self) -> float:
+        if self.n < 2:
+            return math.inf
+        mean = self.mean
+        var = sum((d - mean) ** 2 for d in self.diffs) / (self.n - 1)
+        # 差がすべて同じ (同じバイナリどうしなど) でも割れるようにする
+        return max(var, 1e-12)
+
+    @property
+    def stderr(self) -> float:
+        return math.sqrt(self.variance / self.n) if self.n >= 2 else math.inf
+
+    def llr(self, mu1: float) -> float:
+        """H1: mu = mu1 の H0: mu = 0 に対する対数尤度比"""
+        if self.n < 2:
+            return 0.0
+        return mu1 / self.variance * (sum(self.diffs) - self.n * mu1 / 2)
+
+    def decision(self) -> Optional[str]:
+        if self.n < self.min_samples:
+            return None
+        better = self.llr(self.delta)
+        worse = self.llr(-self.delta)
+        if better >= self.upper:
+            return "better"
+        if worse >= self.upper:
+            return "worse"
+        if better <= self.lower and worse <= self.lower:
+            return "same"
+        return None
+
+
+def compare(
+    binaries,
+    input_dir: Path,
+    work_dir: Path,
+    sprt: PairedSPRT,
+    timeout=60,
+    parallelism=10,
+) -> Optional[str]:
+    """binaries[0] (A) と binaries[1] (B) を input_dir のケースに名前順で並べて流し,
+    seed 順に差を検定に足していく。判定が出たら新しいケースは投げない"""
+    cases = sorted(Path(input_dir).iterdir())
+    sides = []
+    for name, binary in zip("ab", binaries):
+        (work_dir / name / "out").mkdir(parents=True, exist_ok=True)
+        (work_dir / name / "log").mkdir(parents=True, exist_ok=True)
+        sides.append((name, binary, run_local.ResultCache(binary)))
+    input_hashes = {case: run_local.file_hash(case) for case in cases}
+
+    scores = {}
+    in_flight = {}
+    next_submit = 0
+    decision = None
+
+    def submit(executor, index: int):
+        input_file = cases[index]
+        for side, (name, binary, cache) in enumerate(sides):
+            log_file = work_dir / name / "log" / input_file.name
+            entry = cache.load(input_hashes[input_file])
+            if entry is not None:
+                (work_dir / name / "out" / input_file.name).write_text(entry["output"])
+                log_file.write_text(entry["log"])
+                scores[side, index] = run_local.case_score(log_file)
+                continue
+            future = executor.submit(
+                run_local.execute_command,
+                [TESTER, binary],
+                input_file,
+                work_dir / name / "out" / input_file.name,
+                log_file,
+                timeout,
+            )
+            in_flight[future] = (side, index)
+
+    with ThreadPoolExecutor(max_workers=parallelism) as executor:
+        while decision is None and sprt.n < len(cases):
+            # 同じ seed の A と B は続けて投げ, 並べて走らせる
+            while next_submit < len(cases) and len(in_flight) + 2 <= max(
+                parallelism, 2
+            ):
+                submit(executor, next_submit)
+                next_submit += 1
+
+            index = sprt.n
+            if (0, index) in scores and (1, index) in scores:
+                a, b = scores[0, index], scores[1, index]
+                if a is None or b is None:
+                    print(f"{cases[index].name} のパースに失敗しました。")
+                sprt.add((b or 0) - (a or 0))
+                decision = sprt.decision()
+                print(
+                    f"[{sprt.n}] {cases[index].name} A: {a or 0:.4f}, B: {b or 0:.4f}, "
+                    f"差の平均: {sprt.mean:+.4f} ± {sprt.stderr:.4f}, "
+                    f"LLR(better): {sprt.llr(sprt.delta):.2f}, "
+                    f"LLR(worse): {sprt.llr(-sprt.delta):.2f}",
+                    flush=True,
+                )
+                continue
+
+            finished, _ = wait(in_flight, return_when=FIRST_COMPLETED)
+            for future in finished:
+                side, index = in_flight.pop(future)
+                result = future.result()
+                cache = sides[side][2]
+                cache.store(input_hashes[result.input_file], result)
+                scores[side, index] = run_local.case_score(result.log_file)
+        # 判定後に走っているケースは終わるのを待って, キャッシュにだけ残す
+        for future in list(in_flight):
+            side, index = in_flight.pop(future)
+            result = future.result()
+            sides[side][2].store(input_hashes[result.input_file], result)
+
+    for _, _, cache in sides:
+        cache.save_elapsed()
+    return decision
+
+
+if __name__ == "__main__":
+    # usage: compare.py BINARY_A BINARY_B 1-1000 [--delta 0.05]
+    # 同じ seed で A と B を走らせ, B が A より良い / 悪い / 差がないと判定できたら止める
+    parser = argparse.ArgumentParser()
+    parser.add_argument("binary_a")
+    parser.add_argument("binary_b")
+    parser.add_argument("cases", help="data/in の下のディレクトリ名 (例: 1-1000)")
+    parser.add_argument(
+        "--delta", type=float, default=0.05, help="差があるとみなす log2(スコア) の差"
+    )
+    parser.add_argument("--alpha", type=float, default=0.05)
+    parser.add_argument("--beta", type=float, default=0.05)
+    parser.add_argument("--min-samples", type=int, default=30)
+    parser.add_argument("--parallelism", type=int, default=10)
+    parser.add_argument("--timeout", type=float, default=60)
+    args = parser.parse_args()
+
+    sprt = PairedSPRT(args.delta, args.alpha, args.beta, args.min_samples)
+    decision = compare(
+        [args.binary_a, args.binary_b],
+        REPO_ROOT / "data" / "in" / args.cases,
+        REPO_ROOT / "data" / "compare" / args.cases,
+        sprt,
+        timeout=args.timeout,
+        parallelism=args.parallelism,
+    )
+
+    messages = {
+        "better": "B は A より良い",
+        "worse": "B は A より悪い",
+        "same": f"差は {args.delta} 未満",
+        None: "ケースを使い切っても判定できなかった",
+    }
+    print(f"判定: {messages[decision]} ({sprt.n} ケース)")
+    print(f"差の平均 (B - A): {sprt.mean:+.4f} ± {sprt.stderr:.4f}")
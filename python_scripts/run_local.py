@@ -1,14 +1,20 @@
 import os
 import subprocess
+from concurrent.futures import ThreadPoolExecutor, as_completed
 from dataclasses import dataclass
+import hashlib
+import json
+import shutil
 import sys
 from time import time
 from pathlib import Path
-from typing import List
-from joblib import Parallel, delayed
+from typing import List, Optional
 import math
 import util
 
+REPO_ROOT = Path(__file__).resolve().parent.parent
+CACHE_DIR = REPO_ROOT / "data" / "cache"
+
 
 @dataclass
 class ExecuteResult:
@@ -17,13 +23,88 @@ class ExecuteResult:
     log_file: Path
     elapsed: float
     message: str
+    cached: bool = False
 
     def is_succeeded(self) -> bool:
         return not bool(self.message)
 
 
+def file_hash(path: os.PathLike) -> str:
+    h = hashlib.sha256()
+    with open(path, "rb") as f:
+        for chunk in iter(lambda: f.read(1 << 20), b""):
+            h.update(chunk)
+    return h.hexdigest()
+
+
+class ResultCache:
+    """1 ケースの結果を (バイナリのハッシュ, 入力のハッシュ) をキーに保存する
+
+    結果は CACHE_DIR/<バイナリ>/<入力>.json に出力・ログ・実行時間として持つ。
+    env (TUNING ビルドに渡すパラメータなど) を与えたら, それもバイナリ側のキーに含める。
+    成功したケースだけを保存するので, 失敗したケースは毎回実行し直す。
+    実行時間は入力ごとの最新値を CACHE_DIR/elapsed.json にも残し,
+    バイナリが変わったあとの実行順 (長いものから) に使う。
+    """
+
+    def __init__(
+        self, binary_path: os.PathLike, env=None, cache_dir: Path = CACHE_DIR
+    ):
+        key = file_hash(binary_path)
+        if env:
+            key = hashlib.sha256(
+                (key + json.dumps(env, sort_keys=True)).encode()
+            ).hexdigest()
+        self.binary_dir = cache_dir / key
+        self.elapsed_file = cache_dir / "elapsed.json"
+        self.elapsed = (
+            json.loads(self.elapsed_file.read_text())
+            if self.elapsed_file.exists()
+            else {}
+        )
+
+    def load(self, input_hash: str) -> Optional[dict]:
+        path = self.binary_dir / f"{input_hash}.json"
+        return json.loads(path.read_text()) if path.exists() else None
+
+    def store(self, input_hash: str, result: ExecuteResult):
+        self.elapsed[input_hash] = result.elapsed
+        if not result.is_succeeded():
+            return
+        self.binary_dir.mkdir(parents=True, exist_ok=True)
+        entry = {
+            "elapsed": result.elapsed,
+            "output": Path(result.output_file).read_text(),
+            "log": Path(result.log_file).read_text(),
+        }
+        # 書きかけのファイルを読まないように, 書き終えてから置き換える
+        tmp = self.binary_dir / f"{input_hash}.json.tmp"
+        tmp.write_text(json.dumps(entry))
+        tmp.replace(self.binary_dir / f"{input_hash}.json")
+
+    def save_elapsed(self):
+        self.elapsed_file.parent.mkdir(parents=True, exist_ok=True)
+        self.elapsed_file.write_text(json.dumps(self.elapsed))
+
+
+def build(command: str, binary_path: os.PathLike, source_dir: Path = REPO_ROOT / "src"):
+    """ソース一式とビルドコマンドが前回と同じならビルドせずに前回のバイナリを使う"""
+    h = hashlib.sha256(command.encode())
+    for path in sorted(Path(source_dir).rglob("*")):
+        if path.is_file():
+            h.update(str(path.relative_to(source_dir)).encode())
+            h.update(path.read_bytes())
+    cached = CACHE_DIR / "bin" / h.hexdigest()
+    if not cached.exists():
+        subprocess.run(command, shell=True).check_returncode()
+        cached.parent.mkdir(parents=True, exist_ok=True)
+        shutil.copy2(binary_path, cached)
+    elif Path(binary_path).resolve() != cached.resolve():
+        shutil.copy2(cached, binary_path)
+
+
 def execute_command(
-    command, input_file, output_file, log_file, timeout=None
+    command, input_file, output_file, log_file, timeout=None, env=None
 ) -> ExecuteResult:
     start_time = time()
     message = ""
@@ -34,6 +115,7 @@ def execute_command(
             stdout=open(output_file, "w"),
             stderr=open(log_file, "w"),
             timeout=timeout,
+            env=env,
         )
         result.check_returncode()
     except subprocess.TimeoutExpired as e:
@@ -49,28 +131,111 @@ def execute_command(
     return ExecuteResult(input_file, output_file, log_file, elapsed, message)
 
 
+def case_env(input_file, transcript_dir=None, env=None):
+    """1 ケースを走らせる環境変数を作る。追加するものがなければ None (そのまま引き継ぐ)
+
+    transcript_dir が与えられたら記録版のバイナリに記録先を渡し,
+    env (TUNING ビルドへのパラメータなど) はそのまま足す。
+    """
+    if transcript_dir is None and not env:
+        return None
+    extra = dict(env or {})
+    if transcript_dir is not None:
+        extra["TRANSCRIPT"] = str(Path(transcript_dir) / input_file.name)
+    return {**os.environ, **extra}
+
+
 def execute_all(
-    command, input_dir, output_dir, log_dir, timeout=None, parallelism=1
+    command,
+    input_dir,
+    output_dir,
+    log_dir,
+    timeout=None,
+    parallelism=1,
+    transcript_dir=None,
+    use_cache=True,
+    env=None,
 ) -> List[ExecuteResult]:
+    """input_dir の全ケースを実行する。command の最後の要素を解答のバイナリとみなし,
+    同じバイナリと入力の結果がキャッシュにあれば実行せずにそれを使う
+    env は各ケースに追加で渡す環境変数 (TUNING ビルドの PARAMS など)"""
     input_dir = Path(input_dir)
     output_dir = Path(output_dir)
     log_dir = Path(log_dir)
 
     output_dir.mkdir(parents=True, exist_ok=True)
     log_dir.mkdir(parents=True, exist_ok=True)
+    if transcript_dir is not None:
+        Path(transcript_dir).mkdir(parents=True, exist_ok=True)
 
     input_files = [input_dir / file_name for file_name in os.listdir(input_dir)]
 
-    results = Parallel(n_jobs=parallelism, verbose=10)(
-        delayed(execute_command)(
-            command,
-            input_file,
-            output_dir / input_file.name,
-            log_dir / input_file.name,
-            timeout,
-        )
-        for input_file in input_files
+    # 対戦を記録するときは実際に走らせる必要があるのでキャッシュを使わない
+    cache = (
+        ResultCache(command[-1], env)
+        if use_cache and transcript_dir is None
+        else None
     )
+    input_hashes = {input_file: file_hash(input_file) for input_file in input_files}
+
+    results: list[ExecuteResult] = []
+    pending = []
+    for input_file in input_files:
+        entry = cache.load(input_hashes[input_file]) if cache else None
+        if entry is None:
+            pending.append(input_file)
+            continue
+        output_file = output_dir / input_file.name
+        log_file = log_dir / input_file.name
+        output_file.write_text(entry["output"])
+        log_file.write_text(entry["log"])
+        results.append(
+            ExecuteResult(
+                input_file, output_file, log_file, entry["elapsed"], "", cached=True
+            )
+        )
+    scores = [case_score(result.log_file) for result in results]
+    if results:
+        print(
+            f"キャッシュを使ったテストケース: {len(results)}/{len(input_files)}, "
+            f"平均: {mean_score(scores):.4f}"
+        )
+
+    # 前回の実行時間が長いものから流して, 最後に長いケースだけが残らないようにする
+    # 実行時間が分からないものは最初に流す
+    if cache:
+        pending.sort(key=lambda f: -cache.elapsed.get(input_hashes[f], math.inf))
+
+    with ThreadPoolExecutor(max_workers=parallelism) as executor:
+        futures = [
+            executor.submit(
+                execute_command,
+                command,
+                input_file,
+                output_dir / input_file.name,
+                log_dir / input_file.name,
+                timeout,
+                case_env(input_file, transcript_dir, env),
+            )
+            for input_file in pending
+        ]
+        # 終わったものから途中経過を出す
+        for future in as_completed(futures):
+            result = future.result()
+            results.append(result)
+            if cache:
+                cache.store(input_hashes[result.input_file], result)
+            score = case_score(result.log_file)
+            scores.append(score)
+            status = f"{score:.4f}" if score is not None else "失敗"
+            print(
+                f"[{len(results)}/{len(input_files)}] {result.input_file.name} "
+                f"{result.elapsed:.2f} 秒, log2(スコア): {status}, "
+                f"平均: {mean_score(scores):.4f}",
+                flush=True,
+            )
+    if cache:
+        cache.save_elapsed()
     results = sorted(results, key=lambda r: r.input_file.name)
 
     failed_cases = [
@@ -92,31 +257,125 @@ def execute_all(
 
     return results
 
+def execute_batch(bg, ed, log_dir) -> List[Path]:
+    """seed が [bg, ed] の試合を, ジャッジを内蔵したバイナリ 1 プロセスで全コアを使って回す"""
+    log_dir = Path(log_dir)
+    log_dir.mkdir(parents=True, exist_ok=True)
+    subprocess.run(
+        ["./build/bin/batch.out", str(bg), str(ed), str(log_dir)]
+    ).check_returncode()
+    return sorted(log_dir.iterdir())
+
+
+def case_score(log_file: os.PathLike) -> Optional[float]:
+    """ログから log2(スコア) を読む。読めなければ None"""
+    try:
+        score = util.extract_score_from_file(log_file)
+    except Exception:
+        return None
+    return None if score is None else math.log2(max(score, 1))
+
+
+def mean_score(scores: List[Optional[float]]) -> float:
+    """読めなかったケースは parse_scores と同じく 0 として平均する"""
+    return sum(s or 0 for s in scores) / max(len(scores), 1)
+
+
+def read_log_values(log_file: os.PathLike) -> dict:
+    """ログの [key]value の行 (ターンのないもの) を辞書にする"""
+    values = {}
+    try:
+        lines = Path(log_file).read_text().splitlines()
+    except Exception:
+        return values
+    for line in lines:
+        if line.startswith("[") and "](" not in line and "]" in line:
+            key, value = line[1:].split("]", 1)
+            try:
+                values[key] = float(value)
+            except ValueError:
+                pass
+    return values
+
+
+def probe_summary(results: List[ExecuteResult]):
+    """PROBE ビルドのログの [probe_calls:name] と [probe_us:name] を,
+    入力の山の数 M ごとにケースあたりの平均にして表にする"""
+    classes = {}
+    for result in results:
+        with open(result.input_file) as f:
+            n, m, k, t = map(int, f.readline().split())
+        classes.setdefault(m, []).append(read_log_values(result.log_file))
+
+    for m, logs in sorted(classes.items()):
+        names = sorted(
+            {key.split(":", 1)[1] for log in logs for key in log if key.startswith("probe_calls:")}
+        )
+        mean_time = sum(log.get("time", 0) for log in logs) / len(logs)
+        print(f"M = {m}: {len(logs)} ケース, 平均 {mean_time:.0f} ms")
+        # 全角の見出しは 2 桁ぶんとして揃える
+        print(f"  {'計測点':<25}{'回数':>10}{'ms':>10}{'割合':>6}")
+        for name in names:
+            calls = sum(log.get(f"probe_calls:{name}", 0) for log in logs) / len(logs)
+            us = [log[f"probe_us:{name}"] for log in logs if f"probe_us:{name}" in log]
+            # PROBE_COUNT の計測点は回数だけを出す
+            ms = f"{sum(us) / len(logs) / 1000:.1f}" if us else ""
+            share = (
+                f"{sum(us) / len(logs) / 1000 / mean_time * 100:.1f}%"
+                if us and mean_time > 0
+                else ""
+            )
+            print(f"  {name:<28}{calls:>12.0f}{ms:>10}{share:>8}")
+
+
 def parse_scores(results: List[os.PathLike]) -> List[float]:
     scores = []
     for result in results:
-        try:
-            score = util.extract_score_from_file(result)
-            score = max(score, 1)
-        except:
-            score = 1
+        score = case_score(result)
+        if score is None:
+            score = 0
             print(f"{result} のパースに失敗しました。")
-        
-        scores.append(math.log2(score))
+
+        scores.append(score)
     return scores
 
 if __name__ == "__main__":
+    # usage: run_local.py 1-100 [--record | --batch | --probe]
+    # --record をつけると data/transcript/1-100 に対戦を記録する (make bench 用)
+    # --batch をつけると公式ツールの代わりに内蔵のジャッジで seed 1..100 を回す
+    # --probe をつけると計測点 (make probe) の集計を入力の種類ごとに出す
     repo_root_path = Path(__file__).resolve().parent.parent
-    subprocess.run(util.generate_build_command("src/main.cpp", {}, "./build/bin/a.out"), shell=True).check_returncode()
-    results = execute_all(
-        ["./official_tools/target/release/tester", "./build/bin/a.out"],
-        repo_root_path / "data" / "in" / sys.argv[1],
-        repo_root_path / "data" / "out" / sys.argv[1],
-        repo_root_path / "data" / "log" / sys.argv[1],
-        timeout=60,
-        parallelism=10,
-    )
-    scores = parse_scores([result.log_file for result in results])
+    record = "--record" in sys.argv[2:]
+    batch = "--batch" in sys.argv[2:]
+    probe = "--probe" in sys.argv[2:]
+    if batch:
+        build(util.generate_build_command("src/main.cpp", {}, "./build/bin/batch.out", ["BATCH_JUDGE"]), "./build/bin/batch.out")
+        bg, ed = sys.argv[1].split("-")
+        log_files = execute_batch(
+            bg, ed, repo_root_path / "data" / "log" / f"batch-{sys.argv[1]}"
+        )
+    else:
+        defines = ["RECORD_TRANSCRIPT"] if record else []
+        if probe:
+            defines += ["LOCAL", "PROBE"]
+        build(util.generate_build_command("src/main.cpp", {}, "./build/bin/a.out", defines), "./build/bin/a.out")
+        results = execute_all(
+            ["./official_tools/target/release/tester", "./build/bin/a.out"],
+            repo_root_path / "data" / "in" / sys.argv[1],
+            repo_root_path / "data" / "out" / sys.argv[1],
+            repo_root_path / "data" / "log" / sys.argv[1],
+            timeout=60,
+            parallelism=10,
+            transcript_dir=(
+                repo_root_path / "data" / "transcript" / sys.argv[1]
+                if record
+                else None
+            ),
+        )
+        log_files = [result.log_file for result in results]
+        if probe:
+            probe_summary(results)
+    scores = parse_scores(log_files)
 
     if len(scores) != 0:
         average = sum(scores) / len(scores)
@@ -1,4 +1,5 @@
 import subprocess
+from concurrent.futures import FIRST_COMPLETED, ThreadPoolExecutor, wait
 import optuna
 
 import logging
@@ -9,11 +10,20 @@ import os
 import util
 
 import run_local
+import run_shards
 
 FILE_DIR = pathlib.Path(__file__).parent.absolute()
 REPO_ROOT = FILE_DIR.parent.absolute()
 
 TESTCASE_PATH = REPO_ROOT / "data" / "in" / "1-100"
+# REMOTE=local のときに使う, Cloud Run 用と同じくタスクごとに分けた入力
+SHARDED_TESTCASE_PATH = REPO_ROOT / "data" / "in" / "4000"
+TUNING_BINARY_PATH = REPO_ROOT / "build" / "bin" / "tuning.out"
+
+N_TRIALS = 10
+# 同時に進める試行の数と, 全試行で共有するケースの同時実行数
+CONCURRENT_TRIALS = 3
+PARALLELISM = 10
 
 # Add stream handler of stdout to show the messages
 optuna.logging.get_logger("optuna").addHandler(logging.StreamHandler(sys.stdout))
@@ -24,11 +34,14 @@ storage = optuna.storages.RDBStorage(
     url=storage_name, engine_kwargs={"connect_args": {"timeout": 100}}
 )
 
+# ケースは固定の順に流し, 先頭から k ケースの平均をステップ k の途中経過として報告する
+# 同じステップの他の試行の中央値を下回った試行は打ち切る
 study = optuna.create_study(
     study_name=study_name,
     storage=storage,
     load_if_exists=True,
     direction="maximize",
+    pruner=optuna.pruners.MedianPruner(n_startup_trials=5, n_warmup_steps=20),
 )
 
 
@@ -47,10 +60,10 @@ def run_remote(source_path: pathlib.Path, dir: pathlib.Path, build_cmd: str):
             "TASKS": "100",
         }},
     ).check_returncode()
-    return run_local.parse_scores(dir / "out")
+    return run_local.parse_scores(sorted((dir / "out").iterdir()))
 
 
-def objective(trial: optuna.Trial):
+def suggest_params(trial: optuna.Trial):
 
     params = dict(
         # SIMULATION_MS_THRESHOLD=trial.suggest_float("SIMULATION_MS_THRESHOLD", 5, 10, step=0.5),
@@ -67,56 +80,173 @@ def objective(trial: optuna.Trial):
         # SCALE_UP_FREQ_B=trial.suggest_int("SCALE_UP_FREQ_B", 3, 10),
         # SCALE_UP_RATE_C=trial.suggest_float("SCALE_UP_RATE_C", 0.1, 1),
         # C1=trial.suggest_float("C1", 0.1, 10),
-        UCB_C=trial.suggest_float("UCB_C", 0.3, 1.0, step= 0.05),
+        UCB_C=trial.suggest_float("UCB_C", 0.5, 1.5, step=0.05),
+        UCB_C_WHEN_FEW_CARDS=trial.suggest_float("UCB_C_WHEN_FEW_CARDS", 0.3, 1.2, step=0.05),
         # EACH_FIRST_TRIES = trial.suggest_int("EACH_FIRST_TRIES", 20, 50, step=5),
     )
+    return params
 
 
-
-    dirname = tempfile.mkdtemp(suffix=study_name)
-
-    dir = pathlib.Path(dirname)
-    source_path = REPO_ROOT / "build" / "submit.cpp"
-    
-
+def objective_remote(trial: optuna.Trial):
+    params = suggest_params(trial)
+    dir = pathlib.Path(tempfile.mkdtemp(suffix=study_name))
     (dir / "out").mkdir(exist_ok=True)
-
-    if (os.environ.get("REMOTE")):
-        build_cmd = util.generate_build_command("main.cpp", params)
-        average = run_remote(source_path, dir, build_cmd)
-
-    else:
-        with tempfile.TemporaryDirectory(prefix=f"trial{trial.number}") as tmpdirname:
-            bin = tmpdirname + "/a.out"
-            build_cmd = util.generate_build_command(source_path, params, bin)
-            # build
-            print(build_cmd)
-            subprocess.run(
-                build_cmd, shell=True
-            ).check_returncode()
-
-            # prepare dir
-            (dir / "out").mkdir(exist_ok=True)
-            (dir / "log").mkdir(exist_ok=True)
-
-            # run
-            results = run_local.execute_all(
-                 ["./official_tools/target/release/tester", bin],
-                TESTCASE_PATH,
-                dir / "out",
-                dir / "log",
-                timeout=15,
-                parallelism=10,
+    if os.environ.get("REMOTE") == "local":
+        # Cloud Run のジョブと同じ分け方で, このマシンの上で回す
+        log_files = run_shards.run_shards(
+            build_tuning_binary(),
+            SHARDED_TESTCASE_PATH,
+            dir / "out",
+            tasks=100,
+            env=util.generate_params_env(params),
+        )
+        scores = run_local.parse_scores(log_files)
+        return sum(scores) / len(scores)
+    source_path = REPO_ROOT / "build" / "submit.cpp"
+    build_cmd = util.generate_build_command("main.cpp", params)
+    scores = run_remote(source_path, dir, build_cmd)
+    return sum(scores) / len(scores)
+
+
+def build_tuning_binary() -> str:
+    """パラメータは実行時に PARAMS で渡すので, TUNING ビルドは全試行で共有する
+    (ソースが変わらなければ run_local.build がキャッシュを使う)"""
+    TUNING_BINARY_PATH.parent.mkdir(parents=True, exist_ok=True)
+    bin = str(TUNING_BINARY_PATH)
+    build_cmd = util.generate_build_command(
+        REPO_ROOT / "src" / "main.cpp", {}, bin, ["TUNING"]
+    )
+    run_local.build(build_cmd, bin)
+    return bin
+
+
+def stratified_cases(input_dir: pathlib.Path):
+    """ケースを山の数 M ごとに分け, 各グループから 1 つずつ順に取った固定の順に並べる
+
+    どの試行も同じ順に流すので, 先頭の k ケースの平均が試行間で比べられ,
+    k が小さくても M の偏りが少ない
+    """
+    groups = {}
+    for input_file in sorted(input_dir.iterdir()):
+        with open(input_file) as f:
+            n, m, k, t = map(int, f.readline().split())
+        groups.setdefault(m, []).append(input_file)
+    order = []
+    queues = [groups[m] for m in sorted(groups)]
+    while any(queues):
+        for queue in queues:
+            if queue:
+                order.append(queue.pop(0))
+    return order
+
+
+class TrialRun:
+    """実行中の 1 試行. ケースは cases の順に投げ, 終わったものから記録する"""
+
+    def __init__(self, trial: optuna.Trial, binary: str, cases):
+        self.trial = trial
+        self.params = suggest_params(trial)
+        self.env = util.generate_params_env(self.params)
+        self.cache = run_local.ResultCache(binary, self.env)
+        self.cases = cases
+        self.dir = pathlib.Path(tempfile.mkdtemp(prefix=f"trial{trial.number}"))
+        (self.dir / "out").mkdir(exist_ok=True)
+        (self.dir / "log").mkdir(exist_ok=True)
+        self.next_case = 0
+        self.scores = {}
+        self.reported = 0
+        self.done = False
+
+    def has_pending(self) -> bool:
+        return not self.done and self.next_case < len(self.cases)
+
+    def record(self, study: optuna.Study, index: int, score):
+        """ケース index の log2(スコア) を記録し, 先頭から揃ったぶんを報告する"""
+        if self.done:
+            return
+        self.scores[index] = score or 0
+        reported = self.reported
+        while self.reported in self.scores:
+            self.reported += 1
+            self.trial.report(
+                sum(self.scores[i] for i in range(self.reported)) / self.reported,
+                self.reported,
             )
-
-            scores = run_local.parse_scores([result.log_file for result in results])
-            average = sum(scores) / len(scores)
-
-
-    return average;
-
-
-study.optimize(
-    objective,
-    n_trials=10,
-)
+        if self.reported == len(self.cases):
+            self.done = True
+            self.cache.save_elapsed()
+            study.tell(self.trial, sum(self.scores.values()) / len(self.cases))
+        elif self.reported > reported and self.trial.should_prune():
+            self.done = True
+            self.cache.save_elapsed()
+            print(f"trial {self.trial.number}: {self.reported} ケースで打ち切り")
+            study.tell(self.trial, state=optuna.trial.TrialState.PRUNED)
+
+
+def optimize_local(study: optuna.Study, n_trials: int):
+    """CONCURRENT_TRIALS 個の試行を ask/tell で同時に進める
+
+    ケースは全試行で共有する PARALLELISM 本の枠で走らせ, 枠が空くたびに
+    最も進んでいない試行の次のケースを投げる
+    """
+    bin = build_tuning_binary()
+    command = ["./official_tools/target/release/tester", bin]
+
+    cases = stratified_cases(TESTCASE_PATH)
+    input_hashes = {case: run_local.file_hash(case) for case in cases}
+
+    active = []
+    started = 0
+    in_flight = {}
+    with ThreadPoolExecutor(max_workers=PARALLELISM) as executor:
+        while True:
+            while len(active) < CONCURRENT_TRIALS and started < n_trials:
+                active.append(TrialRun(study.ask(), bin, cases))
+                started += 1
+
+            while len(in_flight) < PARALLELISM:
+                runs = [run for run in active if run.has_pending()]
+                if not runs:
+                    break
+                run = min(runs, key=lambda r: r.next_case)
+                index = run.next_case
+                run.next_case += 1
+                input_file = cases[index]
+                log_file = run.dir / "log" / input_file.name
+                entry = run.cache.load(input_hashes[input_file])
+                if entry is not None:
+                    log_file.write_text(entry["log"])
+                    run.record(study, index, run_local.case_score(log_file))
+                    continue
+                future = executor.submit(
+                    run_local.execute_command,
+                    command,
+                    input_file,
+                    run.dir / "out" / input_file.name,
+                    log_file,
+                    15,
+                    run_local.case_env(input_file, env=run.env),
+                )
+                in_flight[future] = (run, index)
+
+            active = [run for run in active if not run.done]
+            if not in_flight:
+                if not active and started >= n_trials:
+                    break
+                continue
+
+            # 打ち切った試行のケースも, 走り出したものは終わるまで待つ
+            finished, _ = wait(in_flight, return_when=FIRST_COMPLETED)
+            for future in finished:
+                run, index = in_flight.pop(future)
+                result = future.result()
+                if run.done:
+                    continue
+                run.cache.store(input_hashes[result.input_file], result)
+                run.record(study, index, run_local.case_score(result.log_file))
+
+
+if os.environ.get("REMOTE"):
+    study.optimize(objective_remote, n_trials=N_TRIALS)
+else:
+    optimize_local(study, N_TRIALS)
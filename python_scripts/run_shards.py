@@ -0,0 +1,123 @@
+import json
+import os
+from concurrent.futures import ThreadPoolExecutor
+from pathlib import Path
+import subprocess
+import sys
+import tempfile
+from typing import List
+
+import run_local
+import util
+
+REPO_ROOT = Path(__file__).resolve().parent.parent
+TASK_SCRIPT = REPO_ROOT / "cloud_run" / "task.sh"
+TESTER = REPO_ROOT / "official_tools" / "target" / "release" / "tester"
+
+
+def list_inputs(input_dir: Path) -> List[Path]:
+    """input_dir 直下のケースと, 分割済み (in/4000 の <タスク番号>/ の形) のケースを集める"""
+    return sorted(
+        (path for path in Path(input_dir).rglob("*") if path.is_file()),
+        key=lambda path: path.name,
+    )
+
+
+def balance(input_files: List[Path], tasks: int, elapsed: dict) -> List[List[Path]]:
+    """予想実行時間の合計が揃うように tasks 個に分ける (長いものから, 合計の最も小さいタスクへ)
+
+    予想実行時間は run_local の elapsed.json (入力のハッシュごとの前回の実行時間) を使い,
+    記録のないケースは記録のあるケースの平均とみなす
+    """
+    predicted = {f: elapsed.get(run_local.file_hash(f)) for f in input_files}
+    known = [t for t in predicted.values() if t is not None]
+    default = sum(known) / len(known) if known else 1.0
+    shards = [[] for _ in range(tasks)]
+    totals = [0.0] * tasks
+    for f in sorted(input_files, key=lambda f: -(predicted[f] or default)):
+        i = min(range(tasks), key=lambda i: totals[i])
+        shards[i].append(f)
+        totals[i] += predicted[f] or default
+    return shards
+
+
+def run_shards(
+    binary_path: os.PathLike,
+    input_dir: os.PathLike,
+    output_dir: os.PathLike,
+    tasks: int,
+    parallelism: int = os.cpu_count() or 1,
+    env=None,
+) -> List[Path]:
+    """Cloud Run のジョブの代わりに, cloud_run/task.sh を tasks 個ローカルで動かす
+
+    入力は予想実行時間で tasks 個に分けて <作業場所>/in/<タスク番号>/ に置き,
+    GCS のパスの代わりにローカルのディレクトリを渡す。各タスクは
+    CLOUD_RUN_TASK_INDEX で自分の入力を選び, 中のケースを並行に走らせる。
+    同時に走るケースの数は全体で parallelism 程度に抑える。
+    env は各タスクに追加で渡す環境変数 (TUNING ビルドの PARAMS など)。
+    出力 (tester の標準エラー) は output_dir に集め, そのパスの一覧を返す
+    """
+    output_dir = Path(output_dir)
+    output_dir.mkdir(parents=True, exist_ok=True)
+    elapsed_file = run_local.CACHE_DIR / "elapsed.json"
+    elapsed = json.loads(elapsed_file.read_text()) if elapsed_file.exists() else {}
+
+    input_files = list_inputs(Path(input_dir))
+    tasks = max(1, min(tasks, len(input_files)))
+    shards = balance(input_files, tasks, elapsed)
+    per_task = max(1, parallelism // tasks)
+
+    with tempfile.TemporaryDirectory(prefix="shards") as tmp:
+        root = Path(tmp)
+        for i, shard in enumerate(shards):
+            (root / "in" / str(i)).mkdir(parents=True)
+            for f in shard:
+                (root / "in" / str(i) / f.name).symlink_to(f.resolve())
+
+        def run_task(i: int):
+            work_dir = root / "task" / str(i)
+            work_dir.mkdir(parents=True)
+            (work_dir / "tester").symlink_to(TESTER.resolve())
+            subprocess.run(
+                ["bash", str(TASK_SCRIPT)],
+                cwd=work_dir,
+                stdout=subprocess.DEVNULL,
+                env={
+                    **os.environ,
+                    **(env or {}),
+                    "CLOUD_RUN_TASK_INDEX": str(i),
+                    # ビルドは済ませてあるので, ソースの代わりにバイナリを配る
+                    "GCS_SOURCE_FILE_PATH": str(Path(binary_path).resolve()),
+                    "CONTAINER_SOURCE_FILE_PATH": "a.out",
+                    "BUILD_COMMAND": "true",
+                    "GCS_INPUT_DIR_PATH": str(root / "in"),
+                    "GCS_OUTPUT_DIR_PATH": str(output_dir.resolve()),
+                    "PARALLELISM": str(per_task),
+                },
+            ).check_returncode()
+
+        with ThreadPoolExecutor(max_workers=max(1, parallelism // per_task)) as executor:
+            list(executor.map(run_task, range(tasks)))
+
+    return sorted(output_dir.joinpath(f.name) for f in input_files)
+
+
+if __name__ == "__main__":
+    # usage: run_shards.py 1-4000 [TASKS]
+    # data/in/1-4000 を TASKS 個 (既定 100) のタスクに分けて回し, data/log/shards-1-4000 に集める
+    tasks = int(sys.argv[2]) if len(sys.argv) >= 3 else 100
+    binary = "./build/bin/a.out"
+    run_local.build(
+        util.generate_build_command("src/main.cpp", {}, binary), binary
+    )
+    log_files = run_shards(
+        binary,
+        REPO_ROOT / "data" / "in" / sys.argv[1],
+        REPO_ROOT / "data" / "log" / f"shards-{sys.argv[1]}",
+        tasks,
+    )
+    scores = run_local.parse_scores(log_files)
+    if len(scores) != 0:
+        print(f"Average: {sum(scores) / len(scores)}")
+    print(f"Valid Cases: {len(scores)}")
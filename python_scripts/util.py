@@ -10,7 +10,44 @@ def extract_score_from_file(file: PathLike):
                 return int(line[len(SCORE_LINE_PREFIX) :].strip())
     return None
 
-def generate_build_command(source_file: PathLike, params, binary_path: PathLike = "a.out"):
-    return f"g++ {str(source_file)} -std=c++23 -O3 -o {str(binary_path)} " + (
-        " ".join([f"-DPARAM_{key}={val}" for key, val in params.items()])
+def generate_build_command(
+    source_file: PathLike, params, binary_path: PathLike = "a.out", defines=()
+):
+    return f"g++ {str(source_file)} -std=c++23 -O3 -pthread -o {str(binary_path)} " + (
+        " ".join(
+            [f"-DPARAM_{key}={val}" for key, val in params.items()]
+            + [f"-D{define}" for define in defines]
+        )
     )
+
+def generate_params_env(params):
+    """TUNING ビルド (make tuning) に実行時のパラメータを渡す環境変数を作る"""
+    return {"PARAMS": " ".join(f"{key}={val}" for key, val in params.items())}
+
+def read_binary_log(file: PathLike):
+    """logger::write_binary (環境変数 LOG_BINARY) の出力を (key, turn, value) の列にする
+    turn のない値の turn は None"""
+    import struct
+
+    with open(file, "rb") as f:
+        data = f.read()
+    assert data[:4] == b"LOG1"
+    pos = 4
+    (key_num,) = struct.unpack_from("<I", data, pos)
+    pos += 4
+    keys = []
+    for _ in range(key_num):
+        (length,) = struct.unpack_from("<H", data, pos)
+        pos += 2
+        keys.append(data[pos : pos + length].decode())
+        pos += length
+    (record_num,) = struct.unpack_from("<I", data, pos)
+    pos += 4
+    records = []
+    for _ in range(record_num):
+        key, is_double, turn = struct.unpack_from("<HBi", data, pos)
+        pos += 7
+        (value,) = struct.unpack_from("<d" if is_double else "<q", data, pos)
+        pos += 8
+        records.append((keys[key], None if turn == 99999999 else turn, value))
+    return records
@@ -0,0 +1,79 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+/// BENCH ビルド (make bench) で, 記録した対戦を再生したときの計測値を集める
+namespace bench {
+    struct Stats {
+        /// ターンごとの所要 tick
+        std::vector<uint64_t> turn_ticks;
+        uint64_t turn_begin = 0;
+        // ロールアウトは先読みスレッドからも数えるので atomic にする
+        std::atomic<uint64_t> rollouts{0};
+        /// ロールアウトで進めたターン数の合計 (シナリオ数倍したもの)
+        std::atomic<uint64_t> rollout_turns{0};
+        std::atomic<uint64_t> rollout_ticks{0};
+
+        inline void begin_turn() { turn_begin = scheduler::TscClock::ticks(); }
+        inline void end_turn() {
+            turn_ticks.push_back(scheduler::TscClock::ticks() - turn_begin);
+        }
+
+        inline void add_rollouts(uint64_t n, uint64_t turns, uint64_t ticks) {
+            rollouts.fetch_add(n, std::memory_order_relaxed);
+            rollout_turns.fetch_add(n * turns, std::memory_order_relaxed);
+            rollout_ticks.fetch_add(ticks, std::memory_order_relaxed);
+        }
+
+        /// @brief ターンの所要時間の p 分位点 (マイクロ秒)
+        int64_t latency_us(double p) const {
+            if (turn_ticks.empty()) return 0;
+            std::vector<uint64_t> sorted = turn_ticks;
+            const size_t i =
+                std::min<size_t>(p * sorted.size(), sorted.size() - 1);
+            std::nth_element(sorted.begin(), sorted.begin() + i, sorted.end());
+            return scheduler::clock().to_us(sorted[i]);
+        }
+
+        /// @brief 計測値を logger に積む
+        void report() const {
+            uint64_t total_ticks = 0;
+            for (auto t : turn_ticks) total_ticks += t;
+            const double total_sec =
+                scheduler::clock().to_us(total_ticks) * 1e-6;
+            const double ns_per_tick = 1e3 / scheduler::clock().rate();
+            logger::push("turns", (int64_t)turn_ticks.size());
+            logger::push("latency_p50_us", latency_us(0.5));
+            logger::push("latency_p90_us", latency_us(0.9));
+            logger::push("latency_p99_us", latency_us(0.99));
+            logger::push("latency_max_us", latency_us(1.0));
+            logger::push("rollouts", (int64_t)rollouts.load());
+            logger::push("rollouts_per_sec",
+                         total_sec > 0 ? rollouts.load() / total_sec : 0.0);
+            logger::push("ns_per_rollout_turn",
+                         rollout_turns.load() > 0
+                             ? rollout_ticks.load() * ns_per_tick
+                                   / rollout_turns.load()
+                             : 0.0);
+        }
+    };
+
+    inline Stats& stats() {
+        static Stats s;
+        return s;
+    }
+
+    /// @brief 生存期間を n 本・turns ターンぶんのロールアウトとして数える
+    struct RolloutTimer {
+        uint64_t n, turns, begin;
+        RolloutTimer(uint64_t n_, int turns_)
+            : n(n_),
+              turns(std::max(turns_, 0)),
+              begin(scheduler::TscClock::ticks()) {}
+        ~RolloutTimer() {
+            stats().add_rollouts(n, turns,
+                                 scheduler::TscClock::ticks() - begin);
+        }
+    };
+} // namespace bench
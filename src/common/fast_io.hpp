@@ -0,0 +1,151 @@
+#include <cerrno>
+#include <cstdint>
+#include <type_traits>
+#include <unistd.h>
+
+namespace fast_io {
+    /// @brief buf の n バイトを fd にすべて書く. fd が負なら何もしない
+    inline void write_all(int fd, const char* buf, int n) {
+        if (fd < 0) return;
+        for (int done = 0; done < n;) {
+            const ssize_t r = ::write(fd, buf + done, n - done);
+            if (r < 0 && errno == EINTR) continue;
+            if (r <= 0) break;
+            done += r;
+        }
+    }
+
+    /// @brief write(2) に直接書き出す出力バッファ
+    /// flush() を呼ぶまで (または満杯になるまで) 書き出さない
+    struct Writer {
+        constexpr static int BUFFER_SIZE = 1 << 12;
+        /// 整数 1 つの最大桁数 (符号込み)
+        constexpr static int INT_DIGITS = 20;
+        /// 書き出し先. 負なら捨てる
+        int fd;
+        /// 書き出した内容の写しを書く先 (負なら書かない)
+        int copy_fd = -1;
+        int len     = 0;
+        char buf[BUFFER_SIZE];
+
+        Writer(int fd_) : fd(fd_) {}
+        ~Writer() { flush(); }
+
+        void flush() {
+            write_all(fd, buf, len);
+            write_all(copy_fd, buf, len);
+            len = 0;
+        }
+
+        inline void put(char c) {
+            if (len == BUFFER_SIZE) flush();
+            buf[len++] = c;
+        }
+
+        inline void put(const char* s) {
+            while (*s) put(*s++);
+        }
+
+        template <typename T>
+        inline void put_int(T x) {
+            static_assert(std::is_integral_v<T>);
+            if (len + INT_DIGITS > BUFFER_SIZE) flush();
+            // 負の数は符号なしで絶対値を取る (最小値でも溢れない)
+            std::make_unsigned_t<T> u = x;
+            if (x < 0) {
+                buf[len++] = '-';
+                u          = -u;
+            }
+            char tmp[INT_DIGITS];
+            int n = 0;
+            do {
+                tmp[n++] = '0' + u % 10;
+                u /= 10;
+            } while (u);
+            while (n) buf[len++] = tmp[--n];
+        }
+
+        template <typename T>
+        inline Writer& operator<<(const T& x) {
+            if constexpr (std::is_same_v<T, char>) {
+                put(x);
+            }
+            else if constexpr (std::is_integral_v<T>) {
+                put_int(x);
+            }
+            else {
+                put(x);
+            }
+            return *this;
+        }
+    };
+
+    /// @brief read(2) から直接読む入力バッファ
+    ///
+    /// バッファが空になったときだけ read し, 届いているぶんだけを受け取る.
+    /// 数は直後の区切り文字 1 つまでしか読まないので, 改行で終わる行を
+    /// 読み終えた時点で, 相手がまだ送っていない入力を待つことはない
+    /// (インタラクティブなジャッジでも止まらない)
+    struct Reader {
+        constexpr static int BUFFER_SIZE = 1 << 16;
+        int fd;
+        /// 入力を待つ前に書き出しておく出力 (cin.tie と同じ役割)
+        Writer* tie;
+        /// 読んだ内容の写しを書く先 (負なら書かない)
+        int copy_fd = -1;
+        int pos     = 0;
+        int len     = 0;
+        char buf[BUFFER_SIZE];
+
+        Reader(int fd_, Writer* tie_ = nullptr) : fd(fd_), tie(tie_) {}
+
+        /// @brief 1 文字読む. 入力が終わっていれば -1
+        inline int get() {
+            if (pos == len && !refill()) return -1;
+            return static_cast<unsigned char>(buf[pos++]);
+        }
+
+        /// @brief 空白を読み飛ばして整数を 1 つ読む
+        template <typename T>
+        T read_int() {
+            static_assert(std::is_integral_v<T>);
+            int c = get();
+            while (c != -1 && c <= ' ') c = get();
+            const bool negative = c == '-';
+            if (negative) c = get();
+            std::make_unsigned_t<T> x = 0;
+            for (; '0' <= c && c <= '9'; c = get()) x = x * 10 + (c - '0');
+            return negative ? -x : x;
+        }
+
+        /// @brief 整数か, 整数を基底に持つ列挙型を 1 つ読む
+        template <typename T>
+        inline T read() {
+            if constexpr (std::is_enum_v<T>) {
+                return static_cast<T>(read_int<std::underlying_type_t<T>>());
+            }
+            else {
+                return read_int<T>();
+            }
+        }
+
+      private:
+        /// @brief バッファが空のときだけ呼ぶ. 届いているぶんだけ受け取る
+        bool refill() {
+            if (tie) tie->flush();
+            ssize_t r;
+            do {
+                r = ::read(fd, buf, BUFFER_SIZE);
+            } while (r < 0 && errno == EINTR);
+            pos = 0;
+            len = r > 0 ? r : 0;
+            write_all(copy_fd, buf, len);
+            return len > 0;
+        }
+    };
+
+    Writer out(STDOUT_FILENO);
+    /// 入力を待つ前に out を書き出すので, 出力は 1 往復につき 1 回だけ
+    /// write される
+    Reader in(STDIN_FILENO, &out);
+} // namespace fast_io
@@ -0,0 +1,43 @@
+/// @brief 容量 CAPACITY の要素を内部に持つ vector. ヒープ確保をしない
+/// 容量を超えて push_back してはいけない
+template <typename T, int CAPACITY>
+struct FixedVector {
+    static_assert(CAPACITY > 0);
+    T data[CAPACITY];
+    int num = 0;
+
+    inline size_t size() const { return num; }
+    inline bool empty() const { return num == 0; }
+    inline void push_back(const T& x) {
+        assert(num < CAPACITY);
+        data[num++] = x;
+    }
+    template <typename... Args>
+    inline void emplace_back(Args&&... args) {
+        assert(num < CAPACITY);
+        data[num++] = T{std::forward<Args>(args)...};
+    }
+    /// @brief pos の位置に x を入れ, 後ろを 1 つずらす
+    inline void insert(int pos, const T& x) {
+        assert(num < CAPACITY && 0 <= pos && pos <= num);
+        for (int i = num; i > pos; --i) data[i] = data[i - 1];
+        data[pos] = x;
+        num++;
+    }
+    /// @brief pos の位置を取り除き, 後ろを 1 つ詰める
+    inline void erase(int pos) {
+        assert(0 <= pos && pos < num);
+        num--;
+        for (int i = pos; i < num; ++i) data[i] = data[i + 1];
+    }
+    inline void pop_back() { num--; }
+    inline void clear() { num = 0; }
+    inline T& back() { return data[num - 1]; }
+    inline const T& back() const { return data[num - 1]; }
+    inline T& operator[](int i) { return data[i]; }
+    inline const T& operator[](int i) const { return data[i]; }
+    inline T* begin() { return data; }
+    inline T* end() { return data + num; }
+    inline const T* begin() const { return data; }
+    inline const T* end() const { return data + num; }
+};
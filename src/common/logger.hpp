@@ -1,58 +1,173 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
 #include <iostream>
-#include <sstream>
+#include <map>
 #include <string>
-#include <tuple>
+#include <type_traits>
 #include <vector>
 
+/// 実行中の値を積んでおき, 終了時にまとめて書き出す
+///
+/// push は型付きの記録をあらかじめ確保したリングに書くだけで,
+/// 文字列の生成やメモリ確保は flush (format) までしない.
+/// LOCAL でないビルド (提出用) では何も記録せず, push は空になる
 namespace logger {
     using namespace std;
     constexpr int INF = 99999999;
 
-    vector<tuple<string, int, string>> logger;
+#ifdef LOCAL
+    constexpr bool ENABLED = true;
+#else
+    constexpr bool ENABLED = false;
+#endif
 
-    inline void push(string key, int turn, int64_t v) {
-        logger.emplace_back(key, turn, to_string(v));
-    }
-    inline void push(const char* key, int turn, int64_t v) {
-        logger.emplace_back(key, turn, to_string(v));
-    }
-    inline void push(string key, int64_t v) { push(key, INF, v); }
-    inline void push(const char* key, int64_t v) { push(key, INF, v); }
+    /// @brief 1 件の記録
+    /// key は文字列リテラルのポインタをそのまま持つ (名前の代わりに使う)
+    struct Record {
+        const char* key;
+        int turn;
+        bool is_double;
+        union {
+            int64_t i;
+            double d;
+        };
+    };
+
+    /// 記録を置くリングの大きさ (2 冪). 溢れたら古いものから上書きする
+    /// 1000 ターン × 数系列のターンごとの記録と, 終了時の集計が入る
+    constexpr int64_t CAPACITY = ENABLED ? 1 << 13 : 1;
+
+    struct Ring {
+        Record records[CAPACITY];
+        /// これまでに積んだ数 (上書きされたものも含む)
+        int64_t pushed = 0;
+
+        inline void push(const Record& r) {
+            records[pushed++ & (CAPACITY - 1)] = r;
+        }
+        inline int64_t size() const { return min(pushed, CAPACITY); }
+        inline int64_t dropped() const { return pushed - size(); }
 
-    inline void puah(string key, int turn, double v) {
-        logger.emplace_back(key, turn, to_string(v));
+        /// @brief 残っている記録を古い順に f に渡す
+        template <typename F>
+        void for_each(F f) const {
+            for (int64_t i = pushed - size(); i < pushed; ++i) {
+                f(records[i & (CAPACITY - 1)]);
+            }
+        }
+    };
+
+    // BATCH_JUDGE では試合ごと (スレッドごと) に持つ
+#ifdef BATCH_JUDGE
+    thread_local
+#endif
+        Ring ring;
+
+    /// @brief turn 時点の値 v を key の系列に積む. key は文字列リテラルに限る
+    template <typename T>
+    inline void push(const char* key, int turn, T v) {
+        static_assert(is_arithmetic_v<T>);
+        if constexpr (ENABLED) {
+            Record r;
+            r.key       = key;
+            r.turn      = turn;
+            r.is_double = is_floating_point_v<T>;
+            if constexpr (is_floating_point_v<T>) {
+                r.d = v;
+            }
+            else {
+                r.i = v;
+            }
+            ring.push(r);
+        }
     }
-    inline void push(const char* key, int turn, double v) {
-        logger.emplace_back(key, turn, to_string(v));
+    template <typename T>
+    inline void push(const char* key, T v) {
+        push(key, INF, v);
     }
-    inline void push(string key, double v) { push(key, INF, v); }
-    inline void push(const char* key, double v) { push(key, INF, v); }
 
-    inline void push(string key, int turn, string v) {
-        logger.emplace_back(key, turn, v);
+    /// @brief 複数のスレッドから足せるカウンタ (ターンごとの集計用)
+    /// LOCAL でないビルドでは何もしない
+    struct Counter {
+#ifdef LOCAL
+        atomic<int64_t> n{0};
+        inline void add(int64_t x) { n.fetch_add(x, memory_order_relaxed); }
+        /// @brief 前回から足された数を返して 0 に戻す
+        inline int64_t take() { return n.exchange(0, memory_order_relaxed); }
+#else
+        inline void add(int64_t) {}
+        inline int64_t take() { return 0; }
+#endif
+    };
+
+    /// @brief 積んだ値を 1 行ずつ [key](turn)v または [key]v にする
+    inline string format() {
+        string s;
+        if constexpr (ENABLED) {
+            ring.for_each([&](const Record& r) {
+                s += '[';
+                s += r.key;
+                s += ']';
+                if (r.turn != INF) {
+                    s += '(';
+                    s += to_string(r.turn);
+                    s += ')';
+                }
+                s += r.is_double ? to_string(r.d) : to_string(r.i);
+                s += '\n';
+            });
+            if (ring.dropped()) {
+                s += "[logger_dropped]" + to_string(ring.dropped()) + "\n";
+            }
+        }
+        return s;
     }
-    inline void push(const char* key, int turn, string v) {
-        logger.emplace_back(key, turn, v);
+
+    /// @brief 積んだ値をまとめて解析する用のバイナリ形式で path に書く
+    /// (python_scripts/util.py の read_binary_log で読む)
+    /// 形式はリトルエンディアンで "LOG1", キーの数 (u32), 各キー (長さ u16,
+    /// 文字列), 記録の数 (u32), 各記録 (キー番号 u16, 実数なら 1 の u8,
+    /// turn i32, 値 i64 か f64)
+    inline bool write_binary(const char* path) {
+        FILE* fp = fopen(path, "wb");
+        if (!fp) return false;
+        auto put = [&](const auto& x) { fwrite(&x, sizeof(x), 1, fp); };
+
+        map<const char*, uint16_t> ids;
+        vector<const char*> keys;
+        ring.for_each([&](const Record& r) {
+            if (ids.emplace(r.key, keys.size()).second) keys.push_back(r.key);
+        });
+        fwrite("LOG1", 1, 4, fp);
+        put((uint32_t)keys.size());
+        for (const char* key : keys) {
+            const string k = key;
+            put((uint16_t)k.size());
+            fwrite(k.data(), 1, k.size(), fp);
+        }
+        put((uint32_t)ring.size());
+        ring.for_each([&](const Record& r) {
+            put(ids[r.key]);
+            put((uint8_t)r.is_double);
+            put((int32_t)r.turn);
+            put(r.i);
+        });
+        return fclose(fp) == 0;
     }
-    inline void push(string key, string v) { push(key, INF, v); }
-    inline void push(const char* key, string v) { push(key, INF, v); }
 
+    inline void clear() { ring.pushed = 0; }
 
+    /// @brief 積んだ値を標準エラーに書く
+    /// 環境変数 LOG_BINARY があれば, そのファイルにバイナリ形式でも書く
     inline void flush() {
-#ifdef LOCAL
-        stringstream ss;
-        for (auto& [key, turn, v] : logger) {
-            // [key](turn)v or [key]v
-            if (turn == INF) {
-                ss << "[" << key << "]" << v << "\n";
-            }
-            else {
-                ss << "[" << key << "](" << turn << ")" << v << "\n";
-            }
+        if constexpr (ENABLED) {
+            cerr << format();
+            cerr.flush();
+            if (const char* path = getenv("LOG_BINARY")) write_binary(path);
         }
-        cerr << ss.str();
-        cerr.flush();
-#endif
     }
 
 } // namespace logger
@@ -2,7 +2,7 @@
 // clang-format off
  #pragma GCC optimize("Ofast")
  #ifndef FLAME_GRAPH
- #pragma GCC target("sse,sse2,sse3,ssse3,sse4,popcnt,abm,mmx,avx")
+ #pragma GCC target("sse,sse2,sse3,ssse3,sse4,popcnt,abm,mmx,avx,avx2")
  #pragma GCC optimize("O3")
  #pragma GCC optimize("omit-frame-pointer")
  #pragma GCC optimize("inline")
@@ -11,3 +11,11 @@
  #endif
 // clang-format on
 #endif
+
+// BATCH_JUDGE では 1 プロセスでスレッドごとに別の試合を進めるので,
+// 試合ごとの状態 (グローバル変数) をスレッドごとに持つ
+#ifdef BATCH_JUDGE
+#define GAME_LOCAL thread_local
+#else
+#define GAME_LOCAL
+#endif
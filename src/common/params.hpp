@@ -0,0 +1,88 @@
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+
+/// @brief TUNING ビルドで調整用の定数を実行時に上書きする
+/// 値は環境変数 PARAMS ("UCB_C=0.5 C1=2" のように空白かカンマ区切り) と,
+/// 環境変数 PARAMS_FILE が指すファイル (同じ形式で改行区切りでもよい) から
+/// 最初に使うときに 1 度だけ読む. 両方に同じ名前があれば PARAMS を優先する
+namespace params {
+    struct Table {
+        std::map<std::string, std::string> values;
+        /// get で問い合わせのあった名前
+        std::set<std::string> used;
+
+        Table() {
+            if (const char* path = getenv("PARAMS_FILE")) {
+                std::ifstream ifs(path);
+                if (!ifs) fail("cannot open PARAMS_FILE", path);
+                std::stringstream ss;
+                ss << ifs.rdbuf();
+                parse(ss.str());
+            }
+            if (const char* text = getenv("PARAMS")) parse(text);
+        }
+
+        void parse(std::string text) {
+            for (char& c : text) {
+                if (c == ',') c = ' ';
+            }
+            std::istringstream is(text);
+            std::string item;
+            while (is >> item) {
+                const size_t eq = item.find('=');
+                if (eq == std::string::npos || eq == 0) {
+                    fail("expected NAME=VALUE", item);
+                }
+                values[item.substr(0, eq)] = item.substr(eq + 1);
+            }
+        }
+
+        [[noreturn]] static void fail(const char* message,
+                                      const std::string& what) {
+            std::cerr << "params: " << message << ": " << what << std::endl;
+            exit(1);
+        }
+    };
+
+    inline Table& table() {
+        static Table t;
+        return t;
+    }
+
+    /// @brief name が上書きされていればその値, なければ default_value
+    template <typename T>
+    T get(const char* name, T default_value) {
+        Table& t = table();
+        t.used.insert(name);
+        const auto it = t.values.find(name);
+        if (it == t.values.end()) return default_value;
+        const std::string& s = it->second;
+        if constexpr (std::is_same_v<T, bool>) {
+            if (s == "1" || s == "true" || s == "True") return true;
+            if (s == "0" || s == "false" || s == "False") return false;
+            Table::fail("expected a bool", s);
+        }
+        else {
+            std::istringstream is(s);
+            T value;
+            if (!(is >> value) || !is.eof()) {
+                Table::fail("cannot parse the value of", name);
+            }
+            return value;
+        }
+    }
+
+    /// @brief 上書きしたのに一度も問い合わせのなかった名前があれば止める
+    /// (名前の綴り間違いや, 実行時には変えられない定数の指定を防ぐ)
+    inline void check_unused() {
+        const Table& t = table();
+        for (const auto& [name, value] : t.values) {
+            if (!t.used.count(name)) Table::fail("unknown parameter", name);
+        }
+    }
+} // namespace params
@@ -0,0 +1,122 @@
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+/// PROBE ビルド (make probe) で, 名前を付けた計測点の呼び出し回数と
+/// 所要 tick を集める. PROBE でなければ PROBE_SCOPE / PROBE_COUNT は空になる
+///
+/// PROBE_SCOPE("name") は囲むスコープの回数と時間を, PROBE_COUNT("name")
+/// は回数だけを数える. name は文字列リテラルに限る. 結果は report() で
+/// logger に [probe_calls:name] と [probe_us:name] として積む
+namespace probe {
+    /// 計測点の数の上限
+    constexpr int MAX_PROBES = 32;
+
+    /// @brief 計測点の名前と, logger に積むときのキー
+    /// 登録は計測点ごとに最初の 1 回だけ (関数内の static の初期化) なので,
+    /// 全スレッドで共有して mutex で守る
+    struct Registry {
+        std::mutex mutex;
+        int size = 0;
+        std::string calls_key[MAX_PROBES];
+        std::string us_key[MAX_PROBES];
+
+        /// @brief name の番号を返す. テンプレートの実体ごとに呼ばれても
+        /// 同じ名前なら同じ番号にまとめる
+        int add(const char* name) {
+            std::lock_guard<std::mutex> lock(mutex);
+            const std::string key = std::string("probe_calls:") + name;
+            for (int id = 0; id < size; ++id) {
+                if (calls_key[id] == key) return id;
+            }
+            if (size == MAX_PROBES) return MAX_PROBES - 1;
+            calls_key[size] = key;
+            us_key[size]    = std::string("probe_us:") + name;
+            return size++;
+        }
+    };
+
+    inline Registry& registry() {
+        static Registry r;
+        return r;
+    }
+
+    /// @brief 計測点ごとの集計. ロールアウトは先読みスレッドや
+    /// ワーカーからも呼ぶので atomic にする
+    struct Slot {
+        std::atomic<uint64_t> calls{0};
+        std::atomic<uint64_t> ticks{0};
+    };
+
+    /// @brief 集計の置き場所. BATCH_JUDGE では試合ごと (スレッドごと) に持つ
+    inline Slot* slots() {
+#ifdef BATCH_JUDGE
+        static thread_local Slot s[MAX_PROBES];
+#else
+        static Slot s[MAX_PROBES];
+#endif
+        return s;
+    }
+
+    inline void count(int id) {
+        slots()[id].calls.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /// @brief 生存期間を計測点 id の 1 回として数える
+    struct ScopedTimer {
+        int id;
+        uint64_t begin;
+        ScopedTimer(int id_) : id(id_), begin(scheduler::TscClock::ticks()) {}
+        ~ScopedTimer() {
+            Slot& s = slots()[id];
+            s.calls.fetch_add(1, std::memory_order_relaxed);
+            s.ticks.fetch_add(scheduler::TscClock::ticks() - begin,
+                              std::memory_order_relaxed);
+        }
+    };
+
+    /// @brief 集計を logger に積む. 呼ばれなかった計測点は書かず,
+    /// PROBE_COUNT の計測点は回数だけを書く
+    inline void report() {
+        // BATCH_JUDGE では他の試合のスレッドが add している最中かもしれない
+        Registry& r = registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        for (int id = 0; id < r.size; ++id) {
+            const Slot& s = slots()[id];
+            if (s.calls == 0) continue;
+            logger::push(r.calls_key[id].c_str(), (int64_t)s.calls.load());
+            if (s.ticks == 0) continue;
+            logger::push(r.us_key[id].c_str(),
+                         scheduler::clock().to_us(s.ticks.load()));
+        }
+    }
+
+    /// @brief 集計を 0 に戻す (BATCH_JUDGE で次の試合を始める前に呼ぶ)
+    inline void reset() {
+        for (int id = 0; id < MAX_PROBES; ++id) {
+            slots()[id].calls = 0;
+            slots()[id].ticks = 0;
+        }
+    }
+} // namespace probe
+
+#define PROBE_CONCAT_(a, b) a##b
+#define PROBE_CONCAT(a, b) PROBE_CONCAT_(a, b)
+#ifdef PROBE
+#define PROBE_SCOPE(name)                                                  \
+    static const int PROBE_CONCAT(probe_id_, __LINE__) =                   \
+        probe::registry().add(name);                                       \
+    probe::ScopedTimer PROBE_CONCAT(probe_timer_, __LINE__)(               \
+        PROBE_CONCAT(probe_id_, __LINE__))
+#define PROBE_COUNT(name)                                                  \
+    do {                                                                   \
+        static const int probe_id = probe::registry().add(name);           \
+        probe::count(probe_id);                                            \
+    } while (0)
+#else
+#define PROBE_SCOPE(name)
+#define PROBE_COUNT(name) \
+    do {                  \
+    } while (0)
+#endif
@@ -0,0 +1,114 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace sampler {
+    /// @brief Walker の alias 法. 64bit の一様乱数 1 つで N 種類から重み付きで選ぶ
+    template <int N>
+    struct AliasTable {
+        double prob[N];
+        int alias[N];
+
+        void build(const double w[N]) {
+            double sum = 0;
+            for (int i = 0; i < N; ++i) sum += w[i];
+            double scaled[N];
+            int small[N], large[N];
+            int small_num = 0, large_num = 0;
+            for (int i = 0; i < N; ++i) {
+                scaled[i] = w[i] * N / sum;
+                alias[i]  = i;
+                if (scaled[i] < 1.0) {
+                    small[small_num++] = i;
+                }
+                else {
+                    large[large_num++] = i;
+                }
+            }
+            while (small_num > 0 && large_num > 0) {
+                const int s = small[--small_num];
+                const int l = large[--large_num];
+                prob[s]     = scaled[s];
+                alias[s]    = l;
+                scaled[l] -= 1.0 - scaled[s];
+                if (scaled[l] < 1.0) {
+                    small[small_num++] = l;
+                }
+                else {
+                    large[large_num++] = l;
+                }
+            }
+            // 誤差で残ったものは確率 1
+            while (small_num > 0) prob[small[--small_num]] = 1.0;
+            while (large_num > 0) prob[large[--large_num]] = 1.0;
+        }
+
+        /// @param u 64bit の一様乱数. 上位 32bit で列, 下位 32bit で表裏を決める
+        inline int sample(uint64_t u) const {
+            const int i       = ((u >> 32) * N) >> 32;
+            const double coin = (u & 0xffffffffu) * 0x1p-32;
+            return coin < prob[i] ? i : alias[i];
+        }
+    };
+
+    /// @brief 有限の整数値の分布を累積分布の逆関数で引く
+    /// 案内表で探索の開始位置を決めるので期待 O(1)
+    struct DiscreteCdf {
+        int64_t offset = 0;
+        /// cdf[i] = P(X <= offset + i). 末尾は 1
+        std::vector<double> cdf;
+        /// guide[g] = cdf[i] > g / guide.size() となる最小の i
+        std::vector<int> guide;
+
+        /// @param pmf pmf[i] = P(X = offset + i) (正規化されていなくてよい)
+        void build(int64_t offset_, const std::vector<double>& pmf) {
+            offset = offset_;
+            cdf.resize(pmf.size());
+            double sum = 0;
+            for (double p : pmf) sum += p;
+            double acc = 0;
+            for (size_t i = 0; i < pmf.size(); ++i) {
+                acc += pmf[i];
+                cdf[i] = acc / sum;
+            }
+            cdf.back() = 1.0;
+            guide.resize(pmf.size());
+            int i = 0;
+            for (size_t g = 0; g < guide.size(); ++g) {
+                while (cdf[i] <= g / double(guide.size())) i++;
+                guide[g] = i;
+            }
+        }
+
+        /// @param u [0, 1) の一様乱数
+        inline int64_t sample(double u) const {
+            int i = guide[int(u * guide.size())];
+            while (cdf[i] <= u) i++;
+            return offset + i;
+        }
+    };
+
+    /// @brief clamp(round(N(mu, sigma)), lo, hi) の分布表を作る
+    /// 平均から離れすぎた裾は端の値にまとめる
+    inline DiscreteCdf rounded_gauss(double mu, double sigma, int64_t lo,
+                                     int64_t hi) {
+        constexpr double tail = 8.0;
+        const int64_t bg =
+            std::max<int64_t>(lo, std::floor(mu - tail * sigma));
+        const int64_t ed = std::min<int64_t>(hi, std::ceil(mu + tail * sigma));
+        auto cdf = [&](double x) {
+            return 0.5 * std::erfc(-(x - mu) / (sigma * std::sqrt(2.0)));
+        };
+        std::vector<double> pmf(ed - bg + 1);
+        for (int64_t c = bg; c <= ed; ++c) {
+            // round は 0.5 を遠い方に丸めるので c は [c - 0.5, c + 0.5)
+            const double l = c == bg ? 0.0 : cdf(c - 0.5);
+            const double r = c == ed ? 1.0 : cdf(c + 0.5);
+            pmf[c - bg]    = r - l;
+        }
+        DiscreteCdf ret;
+        ret.build(bg, pmf);
+        return ret;
+    }
+} // namespace sampler
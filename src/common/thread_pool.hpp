@@ -0,0 +1,191 @@
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace thread_pool {
+    /// @brief 固定数のワーカーで parallel_for を回すスレッドプール
+    /// 呼び出し元スレッドも worker_id = 0 としてタスクを処理する
+    /// 各スレッドは next_task から chunk 個ずつタスクを取っていく
+    struct ThreadPool {
+        /// chunk を自動で決めるとき, 1 スレッドあたりに配る chunk の数
+        /// (多いほど偏りに強く, 少ないほど next_task の取り合いが減る)
+        constexpr static int CHUNKS_PER_WORKER = 4;
+
+        std::vector<std::thread> workers;
+        std::mutex mtx;
+        std::condition_variable cv_start;
+        std::condition_variable cv_done;
+        /// 実行中の parallel_for の f を [begin, end) について呼ぶ関数と,
+        /// 呼び出し元のスタックにある f. chunk ごとに 1 回だけ間接呼び出し
+        /// になり, chunk の中の f の呼び出しはインライン展開される
+        void (*run_chunk)(const void* job, int begin, int end,
+                          int worker_id) = nullptr;
+        const void* job                  = nullptr;
+        std::atomic<int> next_task;
+        int task_num   = 0;
+        int chunk      = 1;
+        int generation = 0;
+        int running    = 0;
+        bool stopping  = false;
+
+        /// @param worker_num 呼び出し元スレッドを含むスレッド数
+        /// @param on_start 各ワーカーの起動時に worker_id を渡して呼ばれる
+        template <typename F>
+        ThreadPool(int worker_num, F on_start) : next_task(0) {
+            for (int id = 1; id < worker_num; ++id) {
+                workers.emplace_back([this, id, on_start] {
+                    on_start(id);
+                    loop(id);
+                });
+            }
+        }
+
+        ~ThreadPool() {
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                stopping = true;
+            }
+            cv_start.notify_all();
+            for (auto& w : workers) w.join();
+        }
+
+        inline int size() const { return workers.size() + 1; }
+
+        /// @brief f(task_id, worker_id) を task_id = [0, n) について実行する
+        /// 戻った時点で全タスクが終わっている
+        /// @param grain 1 度に取るタスクの数. 0 なら n とスレッド数から決める
+        template <typename F>
+        void parallel_for(int n, F&& f, int grain = 0) {
+            if (n <= 0) return;
+            if (workers.empty() || n == 1) {
+                for (int i = 0; i < n; ++i) f(i, 0);
+                return;
+            }
+            using Job = std::remove_reference_t<F>;
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                job       = std::addressof(f);
+                run_chunk = [](const void* p, int begin, int end,
+                               int worker_id) {
+                    Job& g = *const_cast<Job*>(static_cast<const Job*>(p));
+                    for (int i = begin; i < end; ++i) g(i, worker_id);
+                };
+                task_num = n;
+                chunk    = grain > 0
+                               ? grain
+                               : std::max(1, n / (size() * CHUNKS_PER_WORKER));
+                next_task.store(0, std::memory_order_relaxed);
+                running = workers.size();
+                generation++;
+            }
+            cv_start.notify_all();
+            consume(0);
+            std::unique_lock<std::mutex> lock(mtx);
+            cv_done.wait(lock, [&] { return running == 0; });
+        }
+
+      private:
+        inline void consume(int worker_id) {
+            while (true) {
+                const int i =
+                    next_task.fetch_add(chunk, std::memory_order_relaxed);
+                if (i >= task_num) break;
+                run_chunk(job, i, std::min(i + chunk, task_num), worker_id);
+            }
+        }
+
+        void loop(int worker_id) {
+            int seen = 0;
+            while (true) {
+                {
+                    std::unique_lock<std::mutex> lock(mtx);
+                    cv_start.wait(lock, [&] {
+                        return stopping || generation != seen;
+                    });
+                    if (stopping) return;
+                    seen = generation;
+                }
+                consume(worker_id);
+                {
+                    std::lock_guard<std::mutex> lock(mtx);
+                    running--;
+                }
+                cv_done.notify_one();
+            }
+        }
+    };
+
+    /// @brief 1 本のワーカーで仕事を裏で走らせる
+    /// submit した仕事が触るデータは, wait() が戻るまで他から触らないこと
+    struct BackgroundWorker {
+        std::thread worker;
+        std::mutex mtx;
+        std::condition_variable cv;
+        std::function<void()> job;
+        bool has_job  = false;
+        bool stopping = false;
+
+        /// @param on_start ワーカーの起動時に 1 度だけ呼ばれる
+        template <typename F>
+        BackgroundWorker(F on_start) {
+            worker = std::thread([this, on_start] {
+                on_start();
+                loop();
+            });
+        }
+
+        ~BackgroundWorker() {
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                stopping = true;
+            }
+            cv.notify_all();
+            worker.join();
+        }
+
+        /// @brief 前の仕事が終わるのを待ってから f を走らせる
+        template <typename F>
+        void submit(F&& f) {
+            wait();
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                job     = std::forward<F>(f);
+                has_job = true;
+            }
+            cv.notify_all();
+        }
+
+        /// @brief 走らせた仕事が終わるまで待つ
+        void wait() {
+            std::unique_lock<std::mutex> lock(mtx);
+            cv.wait(lock, [&] { return !has_job; });
+        }
+
+      private:
+        void loop() {
+            while (true) {
+                {
+                    std::unique_lock<std::mutex> lock(mtx);
+                    cv.wait(lock, [&] { return stopping || has_job; });
+                    if (!has_job) return;
+                }
+                job();
+                {
+                    std::lock_guard<std::mutex> lock(mtx);
+                    has_job = false;
+                }
+                cv.notify_all();
+            }
+        }
+    };
+
+    inline int hardware_threads() {
+        return std::max(1u, std::thread::hardware_concurrency());
+    }
+} // namespace thread_pool
@@ -1,37 +1,203 @@
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <cstdint>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
 
 namespace scheduler {
     using namespace std::chrono;
-    struct Scheduler {
-        high_resolution_clock::time_point bg;
-        int64_t limit;
-        int64_t progress;
-        int64_t latest;
-        int64_t latest_interval  = 0;
-        constexpr static int buf = 256;
-        int not_updated;
-        Scheduler(int time_limit) {
-            latest      = 0;
-            bg          = high_resolution_clock::now();
-            limit       = time_limit * 1e3;
-            not_updated = 0;
-        }
-        inline bool update() {
-            if (not_updated >= buf) {
-                const int64_t elapsed = duration_cast<microseconds>(
-                                            high_resolution_clock::now() - bg)
-                                            .count();
-                not_updated     = 0;
-                latest_interval = elapsed - latest;
-                latest          = elapsed;
-                progress        = elapsed;
+
+    /// @brief rdtsc を steady_clock で較正した時計
+    /// 読み出しは数 ns なので探索ループの中から呼んでよい
+    /// x86 以外では steady_clock のナノ秒をそのまま tick とする
+    struct TscClock {
+        /// 最初の較正で空回しする時間
+        constexpr static auto CALIBRATION = microseconds(1000);
+        /// 起動時の tick. 経過時間はここから測る
+        uint64_t origin;
+        /// 1 マイクロ秒あたりの tick. calibrate はターンの切り替わりで
+        /// 書き換えるが, 先読みスレッドやワーカーも期限の判定で読むので
+        /// atomic にする. 値 1 つだけなので relaxed で読み書きしてよい
+        std::atomic<double> ticks_per_us;
+        // 較正の基準点
+        uint64_t base_tick;
+        steady_clock::time_point base_time;
+
+        TscClock() {
+            base_time    = steady_clock::now();
+            base_tick    = ticks();
+            origin       = base_tick;
+            ticks_per_us.store(1, std::memory_order_relaxed);
+            while (steady_clock::now() - base_time < CALIBRATION) {
             }
-            else {
-                not_updated++;
-                progress = latest + latest_interval * not_updated / buf;
+            calibrate();
+        }
+
+        static inline uint64_t ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+            return __rdtsc();
+#else
+            return duration_cast<nanoseconds>(
+                       steady_clock::now().time_since_epoch())
+                .count();
+#endif
+        }
+
+        /// @brief 基準点からの tick と steady_clock の差で周波数を測り直す
+        /// 基準点から離れるほど精度が上がるので, ターンの切り替わりで呼ぶ
+        void calibrate() {
+            const uint64_t t = ticks();
+            const double us =
+                duration<double, std::micro>(steady_clock::now() - base_time)
+                    .count();
+            if (us > 0) {
+                ticks_per_us.store((t - base_tick) / us,
+                                   std::memory_order_relaxed);
             }
+        }
+
+        /// @brief 現在の ticks_per_us
+        inline double rate() const {
+            return ticks_per_us.load(std::memory_order_relaxed);
+        }
+        inline int64_t to_us(uint64_t t) const { return t / rate(); }
+        inline uint64_t to_ticks(int64_t us) const {
+            return us <= 0 ? 0 : us * rate();
+        }
+        /// @brief 起動からの経過時間 (マイクロ秒)
+        inline int64_t elapsed_us() const { return to_us(ticks() - origin); }
+    };
+
+    /// @brief プログラム全体で共有する時計. 最初の呼び出しで較正する
+    /// BATCH_JUDGE では試合を進めるスレッドごとに持つ (calibrate が競合する)
+    inline TscClock& clock() {
+#ifdef BATCH_JUDGE
+        static thread_local TscClock c;
+#else
+        static TscClock c;
+#endif
+        return c;
+    }
+
+    /// @brief 期限. sub_us で親を超えない子の期限を作り,
+    /// 試合全体 → ターン → フェーズ のように入れ子にする
+    ///
+    /// alive() は反復ごとに呼ぶ. 時計を読む間隔は計測した 1 反復の
+    /// コストに合わせて決め, 期限の超過を MAX_OVERSHOOT_US と
+    /// max_interval 反復の両方で抑える
+    struct Deadline {
+        constexpr static int64_t MAX_OVERSHOOT_US = 20;
+        constexpr static int DEFAULT_MAX_INTERVAL = 1024;
+        uint64_t begin;
+        uint64_t end;
+        int max_interval;
+        int interval  = 1;
+        int countdown = 1;
+        uint64_t last_check;
+        /// 1 反復あたりの tick の移動平均
+        double ticks_per_iter = 0;
+
+        Deadline(uint64_t begin_tick, uint64_t end_tick,
+                 int max_interval_ = DEFAULT_MAX_INTERVAL)
+            : begin(begin_tick),
+              end(end_tick),
+              max_interval(max_interval_),
+              last_check(begin_tick) {}
+
+        /// @brief 今から us マイクロ秒後の期限
+        static Deadline after_us(int64_t us,
+                                 int max_interval = DEFAULT_MAX_INTERVAL) {
+            const uint64_t now = TscClock::ticks();
+            return Deadline(now, now + clock().to_ticks(us), max_interval);
+        }
+
+        /// @brief プログラムの起動から ms ミリ秒後の期限
+        static Deadline since_start_ms(int ms) {
+            const auto& c = clock();
+            return Deadline(c.origin, c.origin + c.to_ticks(ms * 1000ll));
+        }
+
+        /// @brief 今から us マイクロ秒後と自分の期限の早い方を期限とする子
+        Deadline sub_us(int64_t us,
+                        int max_interval = DEFAULT_MAX_INTERVAL) const {
+            const uint64_t now = TscClock::ticks();
+            return Deadline(now, std::min(end, now + clock().to_ticks(us)),
+                            max_interval);
+        }
+
+        /// @brief 作ってからの経過時間 (マイクロ秒). 時計を読む
+        inline int64_t elapsed_us() const {
+            return clock().to_us(TscClock::ticks() - begin);
+        }
+
+        /// @brief 期限までの残り時間 (マイクロ秒). 時計を読む
+        inline int64_t rest_us() const {
+            const uint64_t now = TscClock::ticks();
+            return now >= end ? 0 : clock().to_us(end - now);
+        }
+
+        /// @brief 時計を読んで期限を過ぎたか調べる
+        inline bool expired() const { return TscClock::ticks() >= end; }
+
+        /// @brief 期限前なら true. 反復ごとに呼ぶ
+        inline bool alive() {
+            if (--countdown > 0) return true;
+            const uint64_t now = TscClock::ticks();
+            if (now >= end) return false;
+            const double per_iter = double(now - last_check) / interval;
+            ticks_per_iter        = ticks_per_iter == 0
+                                        ? per_iter
+                                        : 0.5 * (ticks_per_iter + per_iter);
+            last_check            = now;
+            // 次に読むまでに進む時間が超過の上限と残り時間を超えないようにする
+            const double slack = std::min<double>(
+                end - now, clock().to_ticks(MAX_OVERSHOOT_US));
+            interval = std::clamp<int64_t>(
+                slack / std::max(ticks_per_iter, 1.0), 1, max_interval);
+            countdown = interval;
+            return true;
+        }
+    };
+
+    /// @brief 焼きなまし等でよく使う形. update() が false になったら止める
+    struct Scheduler : Deadline {
+        Scheduler(int time_limit_ms)
+            : Deadline(Deadline::after_us(time_limit_ms * 1000ll)) {}
+        inline bool update() { return alive(); }
+    };
+
+    /// @brief 残りの持ち時間を, 残りのターンの重みに比例して配る
+    /// 配られた時間を使い切らなかったぶんは残り時間に戻るので,
+    /// 以後のターンの配分がそのぶん増える
+    struct TurnBudget {
+        /// 試合全体の期限 (プログラムの起動から測る)
+        Deadline global;
+
+        TurnBudget(int time_limit_ms)
+            : global(Deadline::since_start_ms(time_limit_ms)) {}
+
+        /// @brief 起動時ではなく今から time_limit_ms ミリ秒の持ち時間
+        static TurnBudget starting_now(int time_limit_ms) {
+            TurnBudget ret(time_limit_ms);
+            ret.global = Deadline::after_us(time_limit_ms * 1000ll);
+            return ret;
+        }
+
+        inline int64_t rest_us() const { return global.rest_us(); }
+
+        /// @brief 重み weight のターンに配る時間 (マイクロ秒)
+        /// @param rest_weight このターンより後のターンの重みの合計
+        inline int64_t slice_us(double weight, double rest_weight) const {
+            if (weight <= 0) return 0;
+            return rest_us() * (weight / (weight + rest_weight));
+        }
 
-            return progress < limit;
+        /// @brief 重み weight のターンの期限を作る. ついでに時計を較正する
+        Deadline turn(double weight, double rest_weight) {
+            clock().calibrate();
+            return global.sub_us(slice_us(weight, rest_weight));
         }
     };
 } // namespace scheduler
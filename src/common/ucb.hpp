@@ -1,27 +1,29 @@
+#include <algorithm>
 #include <cmath>
 #include <iostream>
 #include <utility>
 #include <vector>
 
 
+/// @brief 報酬の平均と分散を Welford 法で持つ
+/// E[x^2] - E[x]^2 と違い, 報酬が大きくても桁落ちしない
 struct UcbArmMetrics {
     int count;
-    double total_reward;
-    double total_squared_reward;
+    double mean;
+    /// 平均からの偏差の二乗和
+    double m2;
 
-    UcbArmMetrics() : count(0), total_reward(0.0), total_squared_reward(0.0) {}
+    UcbArmMetrics() : count(0), mean(0.0), m2(0.0) {}
 
     void update(double reward) {
         ++count;
-        total_reward += reward;
-        total_squared_reward += reward * reward;
+        const double delta = reward - mean;
+        mean += delta / count;
+        m2 += delta * (reward - mean);
     }
 
-    inline double average() const { return total_reward / count; }
-    inline double variance() const {
-        const double average = this->average();
-        return total_squared_reward / count - average * average;
-    }
+    inline double average() const { return mean; }
+    inline double variance() const { return m2 / count; }
 
     inline double exploration_factor(int total_count) const {
         return std::sqrt(std::log(total_count) / count);
@@ -31,6 +33,18 @@ struct UcbArmMetrics {
         return average() + c * exploration_factor(total_count);
     }
 
+    /// @brief UCB1. log_total = log(全体の試行回数)
+    /// n は探索項に使う試行回数 (結果待ちの試行を含める)
+    inline double ucb1(double c, double log_total, int n) const {
+        return mean + c * std::sqrt(log_total / n);
+    }
+
+    /// @brief UCB-V (Audibert et al. 2009). b は報酬の幅の見積もり
+    inline double ucbv(double b, double log_total, int n) const {
+        return mean + std::sqrt(2 * variance() * log_total / n)
+               + 3 * b * log_total / n;
+    }
+
     constexpr static double z95 = 1.96; // 95% confidence interval
     constexpr static double z99 = 2.58; // 99% confidence interval
     inline double confidence_interval() const {
@@ -40,10 +54,39 @@ struct UcbArmMetrics {
 
 struct UpperConfidenceBound {
     int total_count;
+    int arms;
     std::vector<UcbArmMetrics> metrics;
+    /// rewards[r * arms + arm]: arm の r 回目の報酬. round ごとに並べるので
+    /// round を増やすときは末尾に足すだけでよい (reserve で先に確保する)
+    std::vector<double> rewards;
+    /// paired[a * arms + b]: 両方が試された round r についての
+    /// arm a と arm b の報酬の差の統計. round ごとに同じ乱数 (シナリオ)
+    /// を使う前提
+    std::vector<UcbArmMetrics> paired;
+    /// これまでの対応のある差の絶対値の最大 (UCB-V の報酬の幅に使う)
+    double max_abs_diff = 0;
+    /// pending[arm]: 選んだがまだ update されていない試行の回数
+    /// 並列に試すとき, 選ぶ側はこれも試行済みとして数える (virtual visit)
+    /// ので, 1 度に配る試行が 1 つの arm に偏らない
+    std::vector<int> pending;
+    int pending_count = 0;
 
-    UpperConfidenceBound(int arms)
-        : total_count(0), metrics(arms, UcbArmMetrics()) {}
+    UpperConfidenceBound(int arms_)
+        : total_count(0),
+          arms(arms_),
+          metrics(arms_, UcbArmMetrics()),
+          paired(arms_ * arms_),
+          pending(arms_) {}
+
+    /// @brief 各 arm を rounds 回まで試す分の領域を確保する
+    /// 以後 rounds 回までは update でメモリ確保が起きない
+    void reserve(int rounds) {
+        if ((int)rewards.size() < rounds * arms) rewards.resize(rounds * arms);
+    }
+
+    inline const UcbArmMetrics& diff(int a, int b) const {
+        return paired[a * arms + b];
+    }
 
     inline double score(int arm, double c) const {
         return metrics[arm].score(c, total_count);
@@ -51,59 +94,269 @@ struct UpperConfidenceBound {
 
     inline double average(int arm) const { return metrics[arm].average(); }
 
+    /// @brief 結果待ちの試行も含めた試行回数
+    inline int issued(int arm) const {
+        return metrics[arm].count + pending[arm];
+    }
+
+    /// @brief arm を結果待ちとして数える. 結果は後で update に渡す
+    inline void add_pending(int arm) {
+        ++pending[arm];
+        ++pending_count;
+    }
+
+    /// @brief 全 arm を通した報酬の合計
+    double reward_sum() const {
+        double sum = 0;
+        for (const auto& m : metrics) sum += m.mean * m.count;
+        return sum;
+    }
+
     inline void update(int arm, double reward) {
+        if (pending[arm] > 0) {
+            --pending[arm];
+            --pending_count;
+        }
         ++total_count;
+        const int round = metrics[arm].count;
         metrics[arm].update(reward);
+        // reserve した回数を超えたときだけ伸ばす
+        if ((int)rewards.size() <= round * arms) reserve(2 * round + 1);
+        double* row = &rewards[round * arms];
+        row[arm]    = reward;
+        for (int i = 0; i < arms; ++i) {
+            if (i == arm || metrics[i].count <= round) continue;
+            const double d = reward - row[i];
+            paired[arm * arms + i].update(d);
+            paired[i * arms + arm].update(-d);
+            max_abs_diff = std::max(max_abs_diff, std::abs(d));
+        }
     }
 
-    int select_arm(double c) const {
-        int ret          = 0;
-        double max_score = score(0, c);
-        for (int i = 1; i < (int)metrics.size(); ++i) {
-            const double s = score(i, c);
-            if (s > max_score) {
-                max_score = s;
-                ret       = i;
-            }
-        }
-        return ret;
+    /// @param limit 試行回数が limit 以上の arm は選ばない. 無ければ -1
+    int select_arm(double c, int limit = NO_LIMIT) const {
+        const double log_total = std::log(total_count + pending_count);
+        return argmax(
+            [&](int i) { return metrics[i].ucb1(c, log_total, issued(i)); },
+            limit);
+    }
+
+    /// @brief UCB-V で選ぶ. 分散の小さい arm を早く見切れる
+    /// 報酬の幅 b には対応のある差の幅 (2 * max_abs_diff) を使う.
+    /// 報酬そのものはシナリオごとに大きく違うが, arm の間の差は
+    /// 同じシナリオで比べたときの差の大きさで決まるため
+    int select_arm_ucbv(int limit = NO_LIMIT) const {
+        const double b         = 2 * max_abs_diff;
+        const double log_total = std::log(total_count + pending_count);
+        return argmax(
+            [&](int i) { return metrics[i].ucbv(b, log_total, issued(i)); },
+            limit);
+    }
+
+    /// @brief 平均の事後分布を正規分布で近似した Thompson sampling
+    /// normal() は標準正規乱数を返す関数
+    template <typename Normal>
+    int select_arm_thompson(Normal&& normal, int limit = NO_LIMIT) const {
+        return argmax(
+            [&](int i) {
+                const auto& m = metrics[i];
+                return m.mean
+                       + std::sqrt(m.variance() / issued(i)) * normal();
+            },
+            limit);
     }
 
     int best_arm() const {
-        int ret          = 0;
-        double max_score = average(0);
-        for (int i = 1; i < (int)metrics.size(); ++i) {
-            const double s = average(i);
-            if (s > max_score) {
-                max_score = s;
-                ret       = i;
-            }
-        }
-        return ret;
+        return argmax([&](int i) { return average(i); });
     }
 
     inline int count(int arm) const { return metrics[arm].count; }
 
-    bool check_early_stop(double c) const {
-        (void)c;
+    /// @brief 最良の arm と, それに最も近い arm との対応のある差が
+    /// 標準誤差の何倍か. 大きいほど決着がついている
+    double paired_gap_z() const {
         const int best = this->best_arm();
-        const double best_lower_bound =
-            metrics[best].average() - metrics[best].confidence_interval();
-        // metrics[best].average()
-        // - c * metrics[best].exploration_factor(total_count);
+        double ret     = 1e18;
+        for (int i = 0; i < (int)metrics.size(); ++i) {
+            if (i == best) {
+                continue;
+            }
+            const auto& diff = this->diff(best, i);
+            if (diff.count < 2) {
+                return 0;
+            }
+            const double se = std::sqrt(std::max(0.0, diff.variance())
+                                        / diff.count);
+            if (se == 0) {
+                continue;
+            }
+            ret = std::min(ret, diff.average() / se);
+        }
+        return ret;
+    }
 
+    /// @brief 最良の arm が他のすべての arm より良いことを
+    /// 対応のある差の信頼区間で判定する
+    bool check_early_stop_paired() const {
+        const int best = this->best_arm();
         for (int i = 0; i < (int)metrics.size(); ++i) {
             if (i == best) {
                 continue;
             }
-            const double upper_bound =
-                metrics[i].average() + metrics[i].confidence_interval();
-            // metrics[i].average()
-            // + c * metrics[i].exploration_factor(total_count);
-            if (upper_bound > best_lower_bound) {
+            const auto& diff = this->diff(best, i);
+            if (diff.count < 2) {
+                return false;
+            }
+            if (diff.average() - diff.confidence_interval() <= 0) {
                 return false;
             }
         }
         return true;
     }
+
+    constexpr static int NO_LIMIT = 1 << 30;
+
+  private:
+
+    /// @brief 結果待ちを含めた試行回数が limit 未満の arm のうち
+    /// score(i) が最大のもの (同点なら番号の小さい方). 無ければ -1
+    template <typename Score>
+    int argmax(Score&& score, int limit = NO_LIMIT) const {
+        int ret          = -1;
+        double max_score = 0;
+        for (int i = 0; i < (int)metrics.size(); ++i) {
+            if (issued(i) >= limit) continue;
+            const double s = score(i);
+            if (ret == -1 || s > max_score) {
+                max_score = s;
+                ret       = i;
+            }
+        }
+        return ret;
+    }
+};
+
+enum class BanditStrategy {
+    UCB1,
+    UCB_V,
+    THOMPSON,
+    SEQUENTIAL_HALVING,
+};
+
+/// @brief 試行回数の予算内で最良の arm を当てる
+/// arm の選び方を strategy で切り替える. 統計は UpperConfidenceBound に持つ
+///
+/// SEQUENTIAL_HALVING は予算を ceil(log2 K) 個のフェーズに等分し,
+/// 各フェーズで残った arm を同じ回数まで試してから下位半分を捨てる
+/// (Karnin et al. 2013). 各 arm の round が揃うので共通乱数の差がそのまま効く
+struct BestArmIdentification {
+    BanditStrategy strategy;
+    UpperConfidenceBound ucb;
+    /// まだ候補に残っている arm
+    std::vector<int> active;
+    /// start() 以後の試行回数の予算
+    int budget;
+    /// start() を呼んだときの試行回数
+    int start_count = 0;
+    /// 1 つの arm の試行回数の上限
+    int max_count = 0;
+    /// 現在のフェーズで各 arm が到達すべき試行回数
+    int phase_target = 0;
+    int phases_left  = 0;
+    /// 次に早期終了を調べる試行回数
+    int next_check = 0;
+
+    /// @param rounds start() までに各 arm を試す回数の見込み
+    BestArmIdentification(int arms, BanditStrategy strategy_, int rounds = 0)
+        : strategy(strategy_), ucb(arms), active(arms), budget(0) {
+        for (int i = 0; i < arms; ++i) active[i] = i;
+        ucb.reserve(rounds);
+    }
+
+    inline void update(int arm, double reward) { ucb.update(arm, reward); }
+    inline int count(int arm) const { return ucb.count(arm); }
+
+    /// @brief arm を結果待ちとして数え, その試行の round を返す
+    /// 同じ arm の結果は round の順に update に渡すこと
+    inline int issue(int arm) {
+        const int round = ucb.issued(arm);
+        ucb.add_pending(arm);
+        return round;
+    }
+
+    /// @brief 以後 budget_ 回試行する. 最初の試行の前に呼ぶ
+    /// @param max_count_ 1 つの arm の試行回数の上限
+    void start(int budget_, int max_count_) {
+        budget    = budget_;
+        max_count = max_count_;
+        ucb.reserve(max_count);
+        start_count = ucb.total_count;
+        phases_left = 0;
+        for (int k = 1; k < (int)active.size(); k *= 2) phases_left++;
+        next_check = ucb.total_count;
+        start_phase();
+    }
+
+    /// @brief 次に試す arm. 終わったなら -1
+    /// 結果待ちの試行があるときの -1 は, それが揃うまで選べないことを表す
+    /// @param c UCB1 の探索係数 (UCB-V は対応のある差から報酬の幅を決める)
+    template <typename Normal>
+    int select_arm(double c, Normal&& normal) {
+        switch (strategy) {
+            case BanditStrategy::UCB1:
+                return ucb.select_arm(c, max_count);
+            case BanditStrategy::UCB_V:
+                return ucb.select_arm_ucbv(max_count);
+            case BanditStrategy::THOMPSON:
+                return ucb.select_arm_thompson(normal, max_count);
+            case BanditStrategy::SEQUENTIAL_HALVING:
+                return select_halving();
+        }
+        return -1;
+    }
+
+    /// @brief 残っている arm の中で平均が最大のもの
+    int best_arm() const {
+        int ret = active[0];
+        for (int arm : active) {
+            if (ucb.average(arm) > ucb.average(ret)) ret = arm;
+        }
+        return ret;
+    }
+
+    /// @brief 対応のある差で決着がついたか. 調べる間隔を試行回数の
+    /// 1/16 ずつ広げるので, 1 試行あたりの償却コストは O(1) になる
+    bool check_early_stop() {
+        if (ucb.total_count < next_check) return false;
+        next_check = ucb.total_count
+                     + std::max<int>(active.size(), ucb.total_count / 16);
+        return ucb.check_early_stop_paired();
+    }
+
+  private:
+    /// @brief 予算の残りを残りのフェーズと arm で等分する
+    void start_phase() {
+        const int rest    = budget - (ucb.total_count - start_count);
+        const int per_arm = rest / std::max(1, phases_left) / active.size();
+        int done          = 0;
+        for (int arm : active) done = std::max(done, ucb.count(arm));
+        phase_target = std::min(max_count, done + std::max(1, per_arm));
+    }
+
+    int select_halving() {
+        while (true) {
+            for (int arm : active) {
+                if (ucb.issued(arm) < phase_target) return arm;
+            }
+            // 平均で比べるのは結果が揃ってから
+            if (ucb.pending_count > 0 || active.size() == 1u) return -1;
+            // フェーズ終了: 同じ round まで揃っているので平均で比べてよい
+            std::stable_sort(active.begin(), active.end(), [&](int a, int b) {
+                return ucb.average(a) > ucb.average(b);
+            });
+            active.resize((active.size() + 1) / 2);
+            phases_left = std::max(1, phases_left - 1);
+            start_phase();
+        }
+    }
 };
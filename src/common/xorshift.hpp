@@ -1,3 +1,4 @@
+#include <cmath>
 #include <cstdint>
 #include <vector>
 
@@ -8,14 +9,243 @@ namespace xorshift {
         return p ^ (p << 17);
     }
 
+    // https://prng.di.unimi.it/splitmix64.c
+    constexpr uint64_t splitmix64(uint64_t x) {
+        x += 0x9e3779b97f4a7c15llu;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9llu;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebllu;
+        return x ^ (x >> 31);
+    }
+
+    constexpr uint64_t DEFAULT_SEED = 939393939393llu;
+
+    constexpr uint64_t rotl(uint64_t x, int k) {
+        return (x << k) | (x >> (64 - k));
+    }
+
+    /// @brief [0, 1) の一様乱数 (53bit)
+    constexpr double to_double(uint64_t x) { return (x >> 11) * 0x1p-53; }
+
+    /// @brief xoshiro256** (周期 2^256 - 1)
+    /// https://prng.di.unimi.it/xoshiro256starstar.c
+    struct Xoshiro256 {
+        uint64_t s[4];
+
+        Xoshiro256(uint64_t seed = DEFAULT_SEED) { set_seed(seed); }
+
+        /// @brief splitmix64 で状態を埋める (全 0 にはならない)
+        void set_seed(uint64_t seed) {
+            for (int i = 0; i < 4; ++i) {
+                s[i] = splitmix64(seed + i * 0x9e3779b97f4a7c15llu);
+            }
+        }
+
+        inline uint64_t gen() {
+            const uint64_t ret = rotl(s[1] * 5, 7) * 9;
+            const uint64_t t   = s[1] << 17;
+            s[2] ^= s[0];
+            s[3] ^= s[1];
+            s[1] ^= s[2];
+            s[0] ^= s[3];
+            s[2] ^= t;
+            s[3] = rotl(s[3], 45);
+            return ret;
+        }
+
+        /// @brief 2^128 回 gen() を呼んだのと同じ位置まで進める
+        void jump() {
+            constexpr uint64_t JUMP[] = {
+                0x180ec6d33cfd0aballu, 0xd5a61266f0c9392cllu,
+                0xa9582618e03fc9aallu, 0x39abdc4529b1661cllu};
+            apply(JUMP);
+        }
+
+        /// @brief 2^192 回 gen() を呼んだのと同じ位置まで進める
+        void long_jump() {
+            constexpr uint64_t LONG_JUMP[] = {
+                0x76e15d3efefdcbbfllu, 0xc5004e441c522fb3llu,
+                0x77710069854ee241llu, 0x39109bb02acbe635llu};
+            apply(LONG_JUMP);
+        }
+
+      private:
+        void apply(const uint64_t poly[4]) {
+            uint64_t t[4] = {};
+            for (int i = 0; i < 4; ++i) {
+                for (int b = 0; b < 64; ++b) {
+                    if (poly[i] & (1llu << b)) {
+                        for (int j = 0; j < 4; ++j) t[j] ^= s[j];
+                    }
+                    gen();
+                }
+            }
+            for (int j = 0; j < 4; ++j) s[j] = t[j];
+        }
+    };
+
+    /// @brief xoshiro256** を LANES 本並べて SoA で持ち, まとめて乱数を作る
+    /// 各レーンは jump() で 2^128 ずつ離してあるので系列は重ならない
+    /// レーン方向のループは自動ベクトル化される
+    struct BulkGenerator {
+        constexpr static int LANES = 8;
+        alignas(64) uint64_t s0[LANES], s1[LANES], s2[LANES], s3[LANES];
+
+        BulkGenerator(uint64_t seed = DEFAULT_SEED) { set_seed(seed); }
+
+        void set_seed(uint64_t seed) { set_state(Xoshiro256(seed)); }
+
+        /// @brief レーン 0 を x から始め, 以降のレーンを jump() で並べる
+        void set_state(Xoshiro256 x) {
+            for (int l = 0; l < LANES; ++l) {
+                s0[l] = x.s[0];
+                s1[l] = x.s[1];
+                s2[l] = x.s[2];
+                s3[l] = x.s[3];
+                x.jump();
+            }
+        }
+
+        /// @brief out[0, n) を一様な 64bit 整数で埋める
+        void fill(uint64_t* out, int n) {
+            int i = 0;
+            for (; i + LANES <= n; i += LANES) step(out + i);
+            if (i < n) {
+                alignas(64) uint64_t rest[LANES];
+                step(rest);
+                for (int l = 0; l < n - i; ++l) out[i + l] = rest[l];
+            }
+        }
+
+        /// @brief out[0, n) を [0, 1) の一様乱数 (53bit) で埋める
+        void fill_double(double* out, int n) {
+            int i = 0;
+            alignas(64) uint64_t buf[LANES];
+            for (; i + LANES <= n; i += LANES) {
+                step(buf);
+                for (int l = 0; l < LANES; ++l) {
+                    out[i + l] = to_double(buf[l]);
+                }
+            }
+            if (i < n) {
+                step(buf);
+                for (int l = 0; l < n - i; ++l) {
+                    out[i + l] = to_double(buf[l]);
+                }
+            }
+        }
+
+      private:
+        /// @brief 全レーンを 1 ステップ進めて LANES 個の乱数を書き込む
+        inline void step(uint64_t* out) {
+            for (int l = 0; l < LANES; ++l) {
+                out[l]           = rotl(s1[l] * 5, 7) * 9;
+                const uint64_t t = s1[l] << 17;
+                s2[l] ^= s0[l];
+                s3[l] ^= s1[l];
+                s1[l] ^= s2[l];
+                s0[l] ^= s3[l];
+                s2[l] ^= t;
+                s3[l] = rotl(s3[l], 45);
+            }
+        }
+    };
+
+    /// @brief BulkGenerator でまとめて作った乱数を 1 つずつ取り出す
     struct Generator {
+        constexpr static int BUFFER_SIZE = 64;
+        BulkGenerator bulk;
+        uint64_t buffer[BUFFER_SIZE];
+        int pos = BUFFER_SIZE;
+        /// 系列を作ったときの seed (状態は 256bit なので seed には戻せない)
         uint64_t seed;
-        Generator(uint64_t seed = 939393939393llu) : seed(seed) {}
+
+        Generator(uint64_t seed = DEFAULT_SEED) : bulk(seed), seed(seed) {}
+
+        /// @brief seed から long_jump() を stream_id 回進めた系列にする
+        /// stream_id が違えば 2^192 以上離れるので並列ワーカーで重ならない
+        Generator(uint64_t seed, int stream_id) : seed(seed) {
+            Xoshiro256 x(seed);
+            for (int i = 0; i < stream_id; ++i) x.long_jump();
+            bulk.set_state(x);
+        }
+
         inline uint64_t gen() {
-            seed = next(seed);
-            return seed;
+            if (pos == BUFFER_SIZE) {
+                bulk.fill(buffer, BUFFER_SIZE);
+                pos = 0;
+            }
+            return buffer[pos++];
+        }
+    };
+
+    /// @brief 標準正規分布の ziggurat 法 (128 層)
+    /// 大半は乱数 1 つと乗算・比較だけで終わる
+    /// Doornik, "An Improved Ziggurat Method to Generate Normal Random
+    /// Samples" (2005)
+    struct Ziggurat {
+        constexpr static int C    = 128;
+        constexpr static double R = 3.442619855899;
+        constexpr static double V = 9.91256303526217e-3;
+        /// x[i]: i 層目の右端. x[0] は裾を含めた底の層の仮想的な幅
+        double x[C + 1];
+        /// ratio[i] = x[i + 1] / x[i]. これより内側なら即採択
+        double ratio[C];
+
+        Ziggurat() {
+            double f = exp(-0.5 * R * R);
+            x[0]     = V / f;
+            x[1]     = R;
+            x[C]     = 0;
+            for (int i = 2; i < C; ++i) {
+                x[i] = sqrt(-2.0 * log(V / x[i - 1] + f));
+                f    = exp(-0.5 * x[i] * x[i]);
+            }
+            for (int i = 0; i < C; ++i) ratio[i] = x[i + 1] / x[i];
         }
-    } _gen;
+
+        /// @brief gen() は 64bit の一様乱数を返す関数
+        template <typename Gen>
+        inline double sample(Gen&& gen) const {
+            while (true) {
+                const uint64_t r = gen();
+                const int i      = r & (C - 1);
+                // 下位 7bit は層の選択に使ったので上位 53bit で [-1, 1)
+                const double u = 2.0 * to_double(r) - 1.0;
+                if (fabs(u) < ratio[i]) return u * x[i];
+                if (i == 0) return tail(gen, u < 0);
+                const double z  = u * x[i];
+                const double f0 = exp(-0.5 * (x[i] * x[i] - z * z));
+                const double f1 = exp(-0.5 * (x[i + 1] * x[i + 1] - z * z));
+                if (f1 + to_double(gen()) * (f0 - f1) < 1.0) return z;
+            }
+        }
+
+      private:
+        /// @brief |z| > R の裾 (Marsaglia の方法)
+        template <typename Gen>
+        static double tail(Gen&& gen, bool negative) {
+            double a, b;
+            do {
+                // log(0) を避けるため (0, 1) にする
+                a = log(to_double(gen()) + 0x1p-54) / R;
+                b = log(to_double(gen()) + 0x1p-54);
+            } while (-2.0 * b < a * a);
+            return negative ? a - R : R - a;
+        }
+    };
+
+    inline const Ziggurat& ziggurat() {
+        static const Ziggurat table;
+        return table;
+    }
+
+    // PARALLEL_ROLLOUT / SPECULATIVE_SEARCH / BATCH_JUDGE ではスレッドごとに
+    // 独立したストリームを持つ
+#if defined(PARALLEL_ROLLOUT) || defined(SPECULATIVE_SEARCH) \
+    || defined(BATCH_JUDGE)
+    thread_local
+#endif
+        Generator _gen;
 
     // https://github.com/yosupo06/library-checker-problems/blob/5face7acd002a8fe2cd76fa6744f0901c194eb36/common/random.h#L38-L51
     // random choice from [0, upper]
@@ -36,14 +266,17 @@ namespace xorshift {
     inline int64_t getInt(int l, int r) { return l + getInt(r - l + 1); }
     inline uint64_t getUint() { return _gen.gen(); }
 
-    inline double getDouble() { return (_gen.gen() % 65536) / 65535.0; }
+    /// @brief [0, 1) の一様乱数 (53bit)
+    inline double getDouble() { return to_double(_gen.gen()); }
     inline double getDouble(double l, double r) {
         return l + getDouble() * (r - l);
     }
+    /// @brief 標準正規分布
+    inline double getNormal() {
+        return ziggurat().sample([] { return _gen.gen(); });
+    }
     inline double gauss(double mu, double sigma) {
-        double z =
-            sqrt(-2.0 * log(getDouble())) * sin(2.0 * M_PI * getDouble());
-        return mu + sigma * z;
+        return mu + sigma * getNormal();
     }
     template <typename T>
     inline void shuffle(std::vector<T>& v) {
@@ -53,6 +286,20 @@ namespace xorshift {
         }
     }
 
+    /// @brief out[0, n) を一様な 64bit 整数でまとめて埋める
+    inline void fill(uint64_t* out, int n) { _gen.bulk.fill(out, n); }
+    /// @brief out[0, n) を [0, 1) の一様乱数でまとめて埋める
+    inline void fill_double(double* out, int n) {
+        _gen.bulk.fill_double(out, n);
+    }
+
     void set_seed(uint64_t seed) { _gen = Generator(seed); }
+    /// @brief 最後に set_seed / set_stream に渡した seed
+    /// set_seed(get_seed()) は系列を続きからではなく最初からやり直す
     uint64_t get_seed() { return _gen.seed; }
+
+    /// @brief seed の系列から stream_id 番目の独立したストリームに切り替える
+    void set_stream(uint64_t seed, int stream_id) {
+        _gen = Generator(seed, stream_id);
+    }
 } // namespace xorshift
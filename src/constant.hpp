@@ -25,60 +25,76 @@ constexpr int K_LB = 2;
 /// @brief ターン数
 constexpr int T = 1000;
 
-constexpr int64_t INF    = 1e18;
-constexpr int64_t ERASED = -INF;
+constexpr int64_t INF = 1e18;
+
+// 調整用の定数 (PARAM_*) は TUNABLE で宣言し, 初期値を tuned に通す.
+// 通常は constexpr のままで, TUNING ビルドでは起動時に
+// params::get で実行時の値に差し替える (再コンパイルせずに試せる)
+#ifdef TUNING
+#define TUNABLE const
+template <typename T>
+inline T tuned(const char* name, T value) {
+    return params::get(name, value);
+}
+#else
+#define TUNABLE constexpr
+template <typename T>
+constexpr T tuned(const char*, T value) {
+    return value;
+}
+#endif
 
-constexpr double SCALE_UP_RATE_A =
+TUNABLE double SCALE_UP_RATE_A = tuned<double>("SCALE_UP_RATE_A",
 #ifdef PARAM_SCALE_UP_RATE_A
     PARAM_SCALE_UP_RATE_A
 #else
     0.85
 #endif
-    ;
+);
 
-constexpr int SCALE_UP_FREQ_A =
+TUNABLE int SCALE_UP_FREQ_A = tuned<int>("SCALE_UP_FREQ_A",
 #ifdef PARAM_SCALE_UP_FREQ_A
     PARAM_SCALE_UP_FREQ_A
 #else
     10
 #endif
-    ;
+);
 
-constexpr double SCALE_UP_RATE_B =
+TUNABLE double SCALE_UP_RATE_B = tuned<double>("SCALE_UP_RATE_B",
 #ifdef PARAM_SCALE_UP_RATE_B
     PARAM_SCALE_UP_RATE_B
 #else
     0.85
 #endif
-    ;
+);
 
-constexpr int SCALE_UP_FREQ_B =
+TUNABLE int SCALE_UP_FREQ_B = tuned<int>("SCALE_UP_FREQ_B",
 #ifdef PARAM_SCALE_UP_FREQ_B
     PARAM_SCALE_UP_FREQ_B
 #else
     5
 #endif
-    ;
+);
 
-constexpr double SCALE_UP_RATE_C =
+TUNABLE double SCALE_UP_RATE_C = tuned<double>("SCALE_UP_RATE_C",
 #ifdef PARAM_SCALE_UP_RATE_C
     PARAM_SCALE_UP_RATE_C
 #else
     0.8
 #endif
-    ;
+);
 
 
-constexpr std::pair<double, int> scale_up_rate_by_current_money_seed[] = {
+TUNABLE std::pair<double, int> scale_up_rate_by_current_money_seed[] = {
     {SCALE_UP_RATE_A, SCALE_UP_FREQ_A},
     {SCALE_UP_RATE_B, SCALE_UP_FREQ_B},
     {SCALE_UP_RATE_C, 21 - SCALE_UP_FREQ_A - SCALE_UP_FREQ_B},
 };
 
-constexpr std::array<double, 21> scale_up_rate_by_current_money = [] {
+TUNABLE std::array<double, 21> scale_up_rate_by_current_money = [] {
     std::array<double, 21> ret{};
-    constexpr auto& g = scale_up_rate_by_current_money_seed;
-    int id            = 0;
+    const auto& g = scale_up_rate_by_current_money_seed;
+    int id        = 0;
     std::fill(ret.begin() + id, ret.begin() + id + g[0].second, g[0].first);
     id += g[0].second;
     std::fill(ret.begin() + id, ret.begin() + id + g[1].second, g[1].first);
@@ -98,13 +114,6 @@ enum CardType {
     CARD_TYPE_NUM,
 };
 
-std::istream& operator>>(std::istream& is, CardType& card_type) {
-    int tmp;
-    is >> tmp;
-    card_type = static_cast<CardType>(tmp);
-    return is;
-}
-
 constexpr int WEIGHT_MAX[]   = {20, 10, 10, 5, 3};
 constexpr int WEIGHT_MAX_SUM = WEIGHT_MAX[WORK_ONE] + WEIGHT_MAX[WORK_ALL]
                                + WEIGHT_MAX[DELETE_ONE] + WEIGHT_MAX[DELETE_ALL]
@@ -127,99 +136,281 @@ constexpr double PROB_MEAN[] = {
     0.375209, 0.211730, 0.211730, 0.120046, 0.081284,
 };
 
-constexpr double SIMULATION_MS_THRESHOLD =
+TUNABLE double SIMULATION_MS_THRESHOLD =
+    tuned<double>("SIMULATION_MS_THRESHOLD",
 #ifdef PARAM_SIMULATION_MS_THRESHOLD
     PARAM_SIMULATION_MS_THRESHOLD
 #else
     6.5
 #endif
-    ;
+);
 
-constexpr int64_t SIMULATION_SAMPLES_WHEN_FAST_CASE =
+TUNABLE int64_t SIMULATION_SAMPLES_WHEN_FAST_CASE =
+    tuned<int64_t>("SIMULATION_SAMPLES_WHEN_FAST_CASE",
 #ifdef PARAM_SIMULATION_SAMPLES_WHEN_FAST_CASE
     PARAM_SIMULATION_SAMPLES_WHEN_FAST_CASE
 #else
     140
 #endif
-    ;
+);
 
-constexpr int64_t SIMULATION_SAMPLES_WHEN_SLOW_CASE =
+TUNABLE int64_t SIMULATION_SAMPLES_WHEN_SLOW_CASE =
+    tuned<int64_t>("SIMULATION_SAMPLES_WHEN_SLOW_CASE",
 #ifdef PARAM_SIMULATION_SAMPLES_WHEN_SLOW_CASE
     PARAM_SIMULATION_SAMPLES_WHEN_SLOW_CASE
 #else
     90
 #endif
-    ;
+);
+
+/// @brief 持ち時間が余るときに 1 候補あたりに使うシナリオの数の上限
+/// (search_sample_num を参照)
+TUNABLE int64_t SIMULATION_SAMPLES_MAX =
+    tuned<int64_t>("SIMULATION_SAMPLES_MAX",
+#ifdef PARAM_SIMULATION_SAMPLES_MAX
+    PARAM_SIMULATION_SAMPLES_MAX
+#else
+    1000
+#endif
+);
 
-constexpr int SIMULATION_TURNS =
+TUNABLE int SIMULATION_TURNS = tuned<int>("SIMULATION_TURNS",
 #ifdef PARAM_SIMULATION_TURNS
     PARAM_SIMULATION_TURNS
 #else
     30
 #endif
-    ;
+);
+
+/// @brief 補充候補が 2 枚のときのロールアウトのターン数の初期値
+TUNABLE int SIMULATION_TURNS_WHEN_FEW_CARDS =
+    tuned<int>("SIMULATION_TURNS_WHEN_FEW_CARDS",
+#ifdef PARAM_SIMULATION_TURNS_WHEN_FEW_CARDS
+    PARAM_SIMULATION_TURNS_WHEN_FEW_CARDS
+#else
+    50
+#endif
+);
+
+/// @brief ロールアウトのターン数を決定の結果から伸び縮みさせるか
+/// false なら SIMULATION_TURNS (補充候補が 2 枚なら
+/// SIMULATION_TURNS_WHEN_FEW_CARDS) で固定する
+TUNABLE bool ADAPTIVE_HORIZON = tuned<bool>("ADAPTIVE_HORIZON",
+#ifdef PARAM_ADAPTIVE_HORIZON
+    PARAM_ADAPTIVE_HORIZON
+#else
+    true
+#endif
+);
+
+/// @brief ロールアウトのターン数の下限 (初期値に対する比)
+TUNABLE double HORIZON_MIN_RATIO = tuned<double>("HORIZON_MIN_RATIO",
+#ifdef PARAM_HORIZON_MIN_RATIO
+    PARAM_HORIZON_MIN_RATIO
+#else
+    0.75
+#endif
+);
+
+/// @brief ロールアウトのターン数の上限 (初期値に対する比)
+TUNABLE double HORIZON_MAX_RATIO = tuned<double>("HORIZON_MAX_RATIO",
+#ifdef PARAM_HORIZON_MAX_RATIO
+    PARAM_HORIZON_MAX_RATIO
+#else
+    1.5
+#endif
+);
+
+/// @brief 途中の評価値を記録する位置 (ロールアウトのターン数に対する比)
+TUNABLE double HORIZON_MID_RATIO = tuned<double>("HORIZON_MID_RATIO",
+#ifdef PARAM_HORIZON_MID_RATIO
+    PARAM_HORIZON_MID_RATIO
+#else
+    0.6
+#endif
+);
+
+/// @brief 途中での最良の候補が最後まで見ると悪いと判断する,
+/// 対応のある差の標準誤差に対する倍率
+TUNABLE double HORIZON_SIGNIFICANT_Z = tuned<double>("HORIZON_SIGNIFICANT_Z",
+#ifdef PARAM_HORIZON_SIGNIFICANT_Z
+    PARAM_HORIZON_SIGNIFICANT_Z
+#else
+    2.0
+#endif
+);
+
+/// @brief 途中と最後で最良の候補が有意に変わったときにターン数に掛ける値
+TUNABLE double HORIZON_GROW_RATE = tuned<double>("HORIZON_GROW_RATE",
+#ifdef PARAM_HORIZON_GROW_RATE
+    PARAM_HORIZON_GROW_RATE
+#else
+    1.25
+#endif
+);
+
+/// @brief 途中と最後で最良の候補が変わらなかったときにターン数に掛ける値
+TUNABLE double HORIZON_SHRINK_RATE = tuned<double>("HORIZON_SHRINK_RATE",
+#ifdef PARAM_HORIZON_SHRINK_RATE
+    PARAM_HORIZON_SHRINK_RATE
+#else
+    0.95
+#endif
+);
+
+/// @brief ロールアウトのターン数を別々に持つ, 試合を等分した区間の数
+constexpr int HORIZON_PHASES = 3;
+
+/// @brief ロールアウトのターン数を別々に持つ scale の境目
+constexpr int HORIZON_SCALE_SPLIT = 10;
+
+// シナリオを作り直す補充候補の重みの変化量 (各種類の確率の差の最大値)
+TUNABLE double SCENARIO_REFRESH_THRESHOLD =
+    tuned<double>("SCENARIO_REFRESH_THRESHOLD",
+#ifdef PARAM_SCENARIO_REFRESH_THRESHOLD
+    PARAM_SCENARIO_REFRESH_THRESHOLD
+#else
+    0.01
+#endif
+);
 
 constexpr int SETUP_TURN = 50;
 
 constexpr int TEARDOWN_TURN = 50;
 
+/// @brief 持ち時間のうちターンに配らずに残しておく時間 (ms)
+TUNABLE int TIME_MARGIN_MS = tuned<int>("TIME_MARGIN_MS",
+#ifdef PARAM_TIME_MARGIN_MS
+    PARAM_TIME_MARGIN_MS
+#else
+    40
+#endif
+);
+
+/// @brief 序盤・終盤のターンに配る時間の重み (その他のターンを 1 とする)
+TUNABLE double SETUP_TEARDOWN_TIME_WEIGHT =
+    tuned<double>("SETUP_TEARDOWN_TIME_WEIGHT",
+#ifdef PARAM_SETUP_TEARDOWN_TIME_WEIGHT
+    PARAM_SETUP_TEARDOWN_TIME_WEIGHT
+#else
+    3.0
+#endif
+);
+
+/// @brief 探索中に時計を読む間隔の上限 (ロールアウトの回数)
+constexpr int SEARCH_MAX_CHECK_INTERVAL = 16;
+
 // 確率調査に用いるサンプルの数
-constexpr int PROBABILITY_SAMPLES =
+TUNABLE int PROBABILITY_SAMPLES = tuned<int>("PROBABILITY_SAMPLES",
 #ifdef PARAM_PROBABILITY_SAMPLES
     PARAM_PROBABILITY_SAMPLES
 #else
     1000
 #endif
-    ;
+);
 
-constexpr double GREEDY_PICK_WORK_THRESHOLD =
+TUNABLE double GREEDY_PICK_WORK_THRESHOLD =
+    tuned<double>("GREEDY_PICK_WORK_THRESHOLD",
 #ifdef PARAM_GREEDY_PICK_WORK_THRESHOLD
     PARAM_GREEDY_PICK_WORK_THRESHOLD
 #else
     0.8
 #endif
-    ;
+);
 
-constexpr double GREEDY_PICK_DELETE_ONE_THRESHOLD =
+TUNABLE double GREEDY_PICK_DELETE_ONE_THRESHOLD =
+    tuned<double>("GREEDY_PICK_DELETE_ONE_THRESHOLD",
 #ifdef PARAM_GREEDY_PICK_DELETE_ONE_THRESHOLD
     PARAM_GREEDY_PICK_DELETE_ONE_THRESHOLD
 #else
     0.01
 #endif
-    ;
+);
 
-constexpr double OVER_THRESHOLD_RATE =
+TUNABLE double OVER_THRESHOLD_RATE = tuned<double>("OVER_THRESHOLD_RATE",
 #ifdef PARAM_OVER_THRESHOLD_RATE
     PARAM_OVER_THRESHOLD_RATE
 #else
     12.0
 #endif
-    ;
+);
 
-constexpr double DELETE_ONE_THRESHOLD_RATE =
+TUNABLE double DELETE_ONE_THRESHOLD_RATE =
+    tuned<double>("DELETE_ONE_THRESHOLD_RATE",
 #ifdef PARAM_DELETE_ONE_THRESHOLD_RATE
     PARAM_DELETE_ONE_THRESHOLD_RATE
 #else
     0.87
 #endif
-    ;
+);
 
-constexpr double C1 =
+TUNABLE double C1 = tuned<double>("C1",
 #ifdef PARAM_C1
     PARAM_C1
 #else
     1
 #endif
-    ;
+);
 
-constexpr double UCB_C =
+/// @brief pick_card と search_use_card の UCB1 の探索係数
+/// 探索フェーズの報酬の合計 / 全体の試行回数 に掛ける
+TUNABLE double UCB_C = tuned<double>("UCB_C",
 #ifdef PARAM_UCB_C
     PARAM_UCB_C
+#else
+    1.0
+#endif
+);
+
+/// @brief 補充候補が 2 枚のときの UCB_C
+TUNABLE double UCB_C_WHEN_FEW_CARDS = tuned<double>("UCB_C_WHEN_FEW_CARDS",
+#ifdef PARAM_UCB_C_WHEN_FEW_CARDS
+    PARAM_UCB_C_WHEN_FEW_CARDS
 #else
     0.7
 #endif
-    ;
+);
+
+/// @brief 序盤・終盤のターンで, 使うカードと対象の山もモンテカルロで選ぶか
+TUNABLE bool JOINT_SEARCH = tuned<bool>("JOINT_SEARCH",
+#ifdef PARAM_JOINT_SEARCH
+    PARAM_JOINT_SEARCH
+#else
+    true
+#endif
+);
+
+/// @brief 使うカードと対象の山の候補数の上限
+TUNABLE int USE_SEARCH_MAX_ARMS = tuned<int>("USE_SEARCH_MAX_ARMS",
+#ifdef PARAM_USE_SEARCH_MAX_ARMS
+    PARAM_USE_SEARCH_MAX_ARMS
+#else
+    8
+#endif
+);
+
+/// @brief 使うカードの選択に配る時間の重み (補充の選択に対する比)
+TUNABLE double USE_SEARCH_TIME_WEIGHT = tuned<double>("USE_SEARCH_TIME_WEIGHT",
+#ifdef PARAM_USE_SEARCH_TIME_WEIGHT
+    PARAM_USE_SEARCH_TIME_WEIGHT
+#else
+    0.1
+#endif
+);
+
+/// @brief pick_card で候補を選ぶ bandit の方策 (BanditStrategy の番号)
+/// 0: UCB1, 1: UCB-V, 2: Thompson sampling, 3: sequential halving
+/// 他の方策が UCB1 より良いと測れるまでは UCB1 のままにする
+TUNABLE int BANDIT_STRATEGY = tuned<int>("BANDIT_STRATEGY",
+#ifdef PARAM_BANDIT_STRATEGY
+    PARAM_BANDIT_STRATEGY
+#else
+    0
+#endif
+);
 
+/// @brief 各候補を最初に試すシナリオの数
+/// Speculation の配列の大きさに使うので, TUNING ビルドでも constexpr のまま
 constexpr int EACH_FIRST_TRIES =
 #ifdef PARAM_EACH_FIRST_TRIES
     PARAM_EACH_FIRST_TRIES
@@ -0,0 +1,190 @@
+/// @brief プロセス内で 1 試合を進めるジャッジ (BATCH_JUDGE 用)
+/// 入力生成は問題文の分布と丸め (round) に従い, 解答側の InputGenerator
+/// とも揃えてある. 乱数は公式の生成器と違うので,
+/// 同じ seed でも公式の入力ファイルと同じ試合にはならない
+///
+/// ジャッジが送る整数は pending に積み, 解答は read<T>() で
+/// fast_io::Reader と同じように 1 つずつ読む
+namespace judge {
+    struct Card {
+        int type;
+        int64_t work_amount;
+        int64_t cost;
+    };
+
+    struct Project {
+        int64_t height;
+        int64_t value;
+    };
+
+    struct Game {
+        uint64_t seed;
+        int n, m, k;
+        int scale     = 0;
+        int turn      = 0;
+        int64_t money = 0;
+        std::vector<Card> hand;
+        std::vector<Project> projects;
+        std::vector<Card> offers;
+        /// 直前に使った手札の位置. 選んだ補充候補はここに入る
+        int used_pos = -1;
+
+        Game(uint64_t seed_) : seed(seed_), rng(seed_) {
+            n = rand_int(N_LB, N_UB);
+            m = rand_int(M_LB, M_UB);
+            k = rand_int(K_LB, K_UB);
+            for (int t = 0; t < CARD_TYPE_NUM; ++t) {
+                weights[t] = rand_int(1, WEIGHT_MAX[t]);
+                weight_sum += weights[t];
+            }
+            hand.assign(n, {WORK_ONE, 1, 0});
+            for (int i = 0; i < m; ++i) projects.push_back(generate_project());
+
+            push(n), push(m), push(k), push(T);
+            for (const auto& c : hand) push(c.type), push(c.work_amount);
+            for (const auto& p : projects) push(p.height), push(p.value);
+        }
+
+        /// @brief ジャッジが送る次の整数を読む. 送られていなければ止める
+        template <typename T>
+        inline T read() {
+            if (pending_pos == pending.size()) fail("read past the input");
+            return static_cast<T>(pending[pending_pos++]);
+        }
+
+        /// @brief 手札 c を山 target に使い, 山と所持金と補充候補を送る
+        void use_card(int c, int target) {
+            if (pending_pos != pending.size()) fail("output before input");
+            if (used_pos != -1) fail("use before pick");
+            if (c < 0 || c >= n) fail("card out of range");
+            const Card card = hand[c];
+            const bool targeted =
+                card.type == WORK_ONE || card.type == DELETE_ONE;
+            if (targeted ? target < 0 || target >= m : target != 0) {
+                fail("project out of range");
+            }
+            switch (card.type) {
+                case WORK_ONE:
+                    work(target, card.work_amount);
+                    break;
+                case WORK_ALL:
+                    for (int i = 0; i < m; ++i) work(i, card.work_amount);
+                    break;
+                case DELETE_ONE:
+                    projects[target] = generate_project();
+                    break;
+                case DELETE_ALL:
+                    for (auto& p : projects) p = generate_project();
+                    break;
+                case SCALE_UP:
+                    if (scale == 20) fail("scale up more than 20 times");
+                    scale++;
+                    break;
+                default:
+                    fail("unknown card type");
+            }
+            used_pos = c;
+
+            // 先頭の候補は必ずコスト 0 の 2^scale の WORK_ONE
+            offers.assign(1, {WORK_ONE, int64_t(1) << scale, 0});
+            for (int i = 1; i < k; ++i) offers.push_back(generate_card());
+
+            pending.clear();
+            pending_pos = 0;
+            for (const auto& p : projects) push(p.height), push(p.value);
+            push(money);
+            for (const auto& o : offers) {
+                push(o.type), push(o.work_amount), push(o.cost);
+            }
+        }
+
+        /// @brief 補充候補 r を買って, 使った手札の位置に入れる
+        void pick_card(int r) {
+            if (pending_pos != pending.size()) fail("output before input");
+            if (used_pos == -1) fail("pick before use");
+            if (r < 0 || r >= k) fail("offer out of range");
+            if (offers[r].cost > money) fail("not enough money");
+            money -= offers[r].cost;
+            hand[used_pos] = offers[r];
+            used_pos       = -1;
+            turn++;
+        }
+
+        inline bool finished() const { return turn == T; }
+
+      private:
+        xorshift::Xoshiro256 rng;
+        int64_t weights[CARD_TYPE_NUM];
+        int64_t weight_sum = 0;
+        std::vector<int64_t> pending;
+        size_t pending_pos = 0;
+
+        inline void push(int64_t x) { pending.push_back(x); }
+
+        /// @brief 不正な出力は解答の誤りなので, その場で止める
+        [[noreturn]] void fail(const char* message) const {
+            std::cerr << "seed " << seed << ", turn " << turn << ": "
+                      << message << std::endl;
+            exit(1);
+        }
+
+        inline double uniform() { return xorshift::to_double(rng.gen()); }
+        inline double normal() {
+            return xorshift::ziggurat().sample([&] { return rng.gen(); });
+        }
+        /// @brief [l, r] の一様な整数 (偏りは 2^-50 程度なので無視する)
+        inline int64_t rand_int(int64_t l, int64_t r) {
+            return l + rng.gen() % (r - l + 1);
+        }
+        inline int64_t rounded_gauss(double mu, double sigma, int64_t lo,
+                                     int64_t hi) {
+            return std::clamp<int64_t>(llround(mu + sigma * normal()), lo, hi);
+        }
+
+        Project generate_project() {
+            const double b = 2.0 + 6.0 * uniform();
+            const double v = std::clamp(b + 0.5 * normal(), 0.0, 10.0);
+            return {llround(exp2(b)) << scale, llround(exp2(v)) << scale};
+        }
+
+        Card generate_card() {
+            int64_t x = rand_int(0, weight_sum - 1);
+            int type  = 0;
+            while (x >= weights[type]) x -= weights[type++];
+            switch (type) {
+                case WORK_ONE: {
+                    const int64_t w = rand_int(1, 50);
+                    return {type, w << scale,
+                            rounded_gauss(w, w / 3.0, 1, 10000) << scale};
+                }
+                case WORK_ALL: {
+                    const int64_t w = rand_int(1, 50);
+                    return {type, w << scale,
+                            rounded_gauss(w * m, w * m / 3.0, 1, 10000)
+                                << scale};
+                }
+                case DELETE_ONE:
+                case DELETE_ALL:
+                    return {type, 0, rand_int(0, 10) << scale};
+                default:
+                    return {type, 0, rand_int(200, 1000) << scale};
+            }
+        }
+
+        /// @brief 山 i の残りを amount 減らし, 片付いたら報酬を得て入れ替える
+        inline void work(int i, int64_t amount) {
+            projects[i].height -= amount;
+            if (projects[i].height <= 0) {
+                money += projects[i].value;
+                projects[i] = generate_project();
+            }
+        }
+    };
+
+    /// @brief このスレッドで進めている試合
+    inline Game*& current() {
+        static thread_local Game* game = nullptr;
+        return game;
+    }
+    inline Game& game() { return *current(); }
+} // namespace judge
@@ -0,0 +1,81 @@
+// BatchEstimator と Estimator::estimate が同じ値を返すかを確かめる
+// (make kernel-check). 提出と同じ最適化 (macros.hpp の Ofast) でビルドする
+// Estimator などは main.cpp のものを使うので, main を除いて取り込む
+#define EXTERNAL_MAIN
+#include "main.cpp"
+
+/// @brief ランダムな局面からの BATCH_LANES 本のロールアウトを,
+/// 同じシナリオで 1 本ずつ行ったものと比べる. 最後と途中の評価値の
+/// どちらかが違うレーンがあれば書き出し, その数を返す
+int check_once(int n, int m, int k) {
+    input::hand.n       = n;
+    input::field.m      = m;
+    input::next_cards.k = k;
+    rollout_kernel::select(n, m, k);
+
+    double w[CARD_TYPE_NUM];
+    for (double& x : w) x = 1 + xorshift::getInt(20);
+    const int scale     = xorshift::getInt(21);
+    const int64_t money = xorshift::getInt(1 << 12) << scale;
+    const int turn      = xorshift::getInt(T - 1);
+    const int turns     = 1 + xorshift::getInt(SCENARIO_RING_SIZE - 1);
+    const auto [last_turn, mid_turn] = rollout_span(turn, turns);
+
+    InputGenerator generator;
+    generator.set_weights(w);
+    Hand h;
+    h.n = n;
+    for (int i = 0; i < n; ++i) {
+        h.cards[i] = generator.generate_card(scale, m);
+    }
+    Field f;
+    f.m = m;
+    for (int i = 0; i < m; ++i) {
+        f.mountains[i] = generator.generate_mountain(scale);
+    }
+    f.live        = f.all_mask();
+    f.order_dirty = true;
+
+    static Estimator scenarios[BATCH_LANES];
+    const Estimator* lanes[BATCH_LANES];
+    for (int l = 0; l < BATCH_LANES; ++l) {
+        scenarios[l].input_generator.set_weights(w);
+        scenarios[l].clear();
+        scenarios[l].advance(turn, last_turn);
+        lanes[l] = &scenarios[l];
+    }
+
+    double out[BATCH_LANES], mid_out[BATCH_LANES] = {};
+    rollout_kernel::current.batch_estimate(lanes, turn, last_turn, money,
+                                           scale, h, f, out, mid_turn,
+                                           mid_out);
+    int failed = 0;
+    for (int l = 0; l < BATCH_LANES; ++l) {
+        double mid      = 0;
+        const double sc = rollout_kernel::current.estimate(
+            scenarios[l], turn, last_turn, money, scale, h, f, mid_turn, &mid);
+        if (sc == out[l] && mid == mid_out[l]) continue;
+        failed++;
+        cout << "NG (n, m, k) = (" << n << ", " << m << ", " << k
+             << "), turn " << turn << "-" << last_turn << ", scale " << scale
+             << ", money " << money << ": batch " << out[l] << " / "
+             << mid_out[l] << ", scalar " << sc << " / " << mid << endl;
+    }
+    return failed;
+}
+
+/// @usage kernel_check.out [TRIALS]
+/// 局面を TRIALS 個作り, 一致しなかったロールアウトがあれば 1 を返す
+int main(int argc, char* argv[]) {
+    const int trials = argc >= 2 ? stoi(argv[1]) : 2000;
+    xorshift::set_seed(xorshift::DEFAULT_SEED);
+    int failed = 0;
+    for (int t = 0; t < trials; ++t) {
+        failed += check_once(xorshift::getInt(N_LB, N_UB),
+                             xorshift::getInt(M_LB, M_UB),
+                             xorshift::getInt(K_LB, K_UB));
+    }
+    cout << "Rollouts: " << trials * BATCH_LANES << ", failed: " << failed
+         << endl;
+    return failed ? 1 : 0;
+}
@@ -6,14 +6,38 @@
 #include "common/stl.hpp"
 #include "common/sa.hpp"
 #include "common/time_scheduler.hpp"
+#include "common/fast_io.hpp"
 #include "common/xorshift.hpp"
 #include "common/logger.hpp"
+#include "common/probe.hpp"
 #include "common/original_vector.hpp"
+#include "common/fixed_vector.hpp"
 #include "common/ucb.hpp"
+#include "common/sampler.hpp"
+#if defined(PARALLEL_ROLLOUT) || defined(SPECULATIVE_SEARCH) \
+    || defined(BATCH_JUDGE)
+#include "common/thread_pool.hpp"
+#endif
+#ifdef BENCH
+#include "common/bench.hpp"
+#endif
+
+#ifdef TUNING
+#include "common/params.hpp"
+#endif
 
 #include "constant.hpp"
+#ifdef BATCH_JUDGE
+#include "judge.hpp"
+#endif
 // clang-format on
 
+#if defined(BATCH_JUDGE) \
+    && (defined(PARALLEL_ROLLOUT) || defined(SPECULATIVE_SEARCH))
+// 試合ごとにスレッドを割り当てるので, 試合の中ではスレッドを増やさない
+#error "BATCH_JUDGE cannot be combined with PARALLEL_ROLLOUT/SPECULATIVE_SEARCH"
+#endif
+
 
 struct Card {
     int id;
@@ -27,12 +51,91 @@ struct Mountain {
     int64_t value;
 };
 
+/// @brief value / height が a の方が真に大きいか. 整数のまま掛けて比べる
+/// (value < 2^31, height < 2^29 なので積は int64 に収まる)
+inline bool higher_ratio(const Mountain& a, const Mountain& b) {
+    return a.value * b.height > b.value * a.height;
+}
+
+/// @brief 山の状態. 消えた山を live で, value / height が最大・最小の山を
+/// best_pos / worst_pos で持ち, 山が変わるたびに差分で更新する
+/// 同じ比なら添字が小さい方を選ぶ
 struct Field {
     int m;
     Mountain mountains[M_UB];
-    void load() {
+    /// bit i が立っていれば山 i は残っている
+    uint32_t live = 0;
+    int best_pos  = 0;
+    int worst_pos = 0;
+    /// best_pos / worst_pos を作り直す必要があるか
+    bool order_dirty = true;
+
+    /// @param in fast_io::Reader か judge::Game
+    template <typename In>
+    void load(In& in) {
         for (int i = 0; i < m; ++i) {
-            cin >> mountains[i].height >> mountains[i].value;
+            mountains[i].height = in.template read<int64_t>();
+            mountains[i].value  = in.template read<int64_t>();
+        }
+        live        = all_mask();
+        order_dirty = true;
+    }
+
+    inline uint32_t all_mask() const { return (1u << m) - 1; }
+    inline bool is_live(int i) const { return live >> i & 1; }
+
+    /// @brief 山 i を mt にして残っている山に加える
+    inline void put(int i, const Mountain& mt) {
+        mountains[i] = mt;
+        live |= 1u << i;
+        if (!order_dirty) update_order(i);
+    }
+
+    /// @brief 山 i を消す
+    inline void erase(int i) {
+        live &= ~(1u << i);
+        order_dirty |= i == best_pos || i == worst_pos;
+    }
+
+    /// @brief 山 i を amount だけ低くする. 高さが 0 以下になったら消して
+    /// その価値を返す
+    inline int64_t work(int i, int64_t amount) {
+        mountains[i].height -= amount;
+        if (mountains[i].height <= 0) {
+            erase(i);
+            return mountains[i].value;
+        }
+        // 比は大きくなる一方なので最小だったときだけ作り直す
+        if (i == worst_pos) {
+            order_dirty = true;
+        }
+        else if (!order_dirty) {
+            update_order(i);
+        }
+        return 0;
+    }
+
+    /// @brief 残っている山の中での best_pos / worst_pos を揃える
+    inline void refresh_order() {
+        if (!order_dirty) return;
+        assert(live != 0);
+        best_pos = worst_pos = __builtin_ctz(live);
+        for (uint32_t rest = live & (live - 1); rest; rest &= rest - 1) {
+            update_order(__builtin_ctz(rest));
+        }
+        order_dirty = false;
+    }
+
+  private:
+    inline void update_order(int i) {
+        const auto& mt = mountains[i];
+        if (higher_ratio(mt, mountains[best_pos])
+            || (i < best_pos && !higher_ratio(mountains[best_pos], mt))) {
+            best_pos = i;
+        }
+        if (higher_ratio(mountains[worst_pos], mt)
+            || (i < worst_pos && !higher_ratio(mt, mountains[worst_pos]))) {
+            worst_pos = i;
         }
     }
 };
@@ -40,9 +143,11 @@ struct Field {
 struct Hand {
     int n;
     Card cards[N_UB];
-    void load() {
+    template <typename In>
+    void load(In& in) {
         for (int i = 0; i < n; ++i) {
-            cin >> cards[i].type >> cards[i].work_amount;
+            cards[i].type        = in.template read<CardType>();
+            cards[i].work_amount = in.template read<int64_t>();
         }
     }
     void assign_id() {
@@ -65,9 +170,12 @@ struct Hand {
 struct NextCards {
     int k;
     Card cards[K_UB];
-    void load() {
+    template <typename In>
+    void load(In& in) {
         for (int i = 0; i < k; ++i) {
-            cin >> cards[i].type >> cards[i].work_amount >> cards[i].cost;
+            cards[i].type        = in.template read<CardType>();
+            cards[i].work_amount = in.template read<int64_t>();
+            cards[i].cost        = in.template read<int64_t>();
         }
     }
     void assign_id() {
@@ -86,39 +194,84 @@ struct NextCards {
     }
 };
 
+/// 出力は fast_io::out に溜め, 次に入力を待つとき (と終了時) にまとめて
+/// 書き出す. ジャッジは pick の行には応答しないので, pick と次のターンの
+/// use は 1 回の write で送られる
+/// BATCH_JUDGE ではこのスレッドの judge::Game と直接やり取りする
 namespace io {
+#ifdef BATCH_JUDGE
+    inline judge::Game& source() { return judge::game(); }
+#else
+    inline fast_io::Reader& source() { return fast_io::in; }
+#endif
+
     void input_first(Hand& hand, Field& field, NextCards& next_cards) {
-        int t;
-        cin >> hand.n >> field.m >> next_cards.k >> t;
-        hand.load();
+        auto& in     = source();
+        hand.n       = in.read<int>();
+        field.m      = in.read<int>();
+        next_cards.k = in.read<int>();
+        in.read<int>(); // T
+        hand.load(in);
         hand.assign_id();
-        field.load();
+        field.load(in);
     }
 
     void input_next(int64_t& money, Field& field, NextCards& next_cards) {
-        field.load();
-        cin >> money;
+        auto& in = source();
+        field.load(in);
+        money = in.read<int64_t>();
 // -Werror=array-bounds を無視
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Warray-bounds"
-        next_cards.load();
+        next_cards.load(in);
         next_cards.assign_id();
         next_cards.sort_by_cost_amount();
 #pragma GCC diagnostic pop
     }
 
     void output_use_card(int c_pos, int m_pos) {
-        cout << c_pos << " " << m_pos << endl;
+#ifdef BATCH_JUDGE
+        judge::game().use_card(c_pos, m_pos);
+#else
+        fast_io::out << c_pos << ' ' << m_pos << '\n';
+#endif
+    }
+
+    void output_pick_card(int k_pos) {
+#ifdef BATCH_JUDGE
+        judge::game().pick_card(k_pos);
+#else
+        fast_io::out << k_pos << '\n';
+#endif
+    }
+
+    void flush() { fast_io::out.flush(); }
+
+#ifdef BENCH
+    /// @brief 記録の再生では, 出力した手の後に記録された手を読む
+    /// 以後の入力と状態が記録と揃うように, 探索で選んだ手をこれで置き換える
+    void replay_use_card(int& c_pos, int& m_pos) {
+        c_pos = fast_io::in.read<int>();
+        m_pos = fast_io::in.read<int>();
     }
 
-    void output_pick_card(int k_pos) { cout << k_pos << endl; }
+    /// @return 記録で選ばれた補充候補の next_cards での位置
+    int replay_pick_card(const NextCards& next_cards) {
+        const int id = fast_io::in.read<int>();
+        for (int i = 0; i < next_cards.k; ++i) {
+            if (next_cards.cards[i].id == id) return i;
+        }
+        assert(false);
+        return 0;
+    }
+#endif
 
 } // namespace io
 
 namespace input {
-    Hand hand;
-    Field field;
-    NextCards next_cards;
+    GAME_LOCAL Hand hand;
+    GAME_LOCAL Field field;
+    GAME_LOCAL NextCards next_cards;
 } // namespace input
 
 using C = Card;
@@ -131,68 +284,89 @@ inline double clamp_double(double x, double l, double r) {
     return max(l, min(r, x));
 }
 
+/// @brief 公式の入力生成と同じ分布で山と補充候補を生成する
+/// 種類は alias 法で, WORK_ONE / WORK_ALL のコストは w_dash ごとの
+/// 分布表から引くので, 1 枚あたりの超越関数の呼び出しがない
 struct InputGenerator {
-    double w[5];
+    sampler::AliasTable<CARD_TYPE_NUM> type_table;
+
+    /// @brief コストの分布表. m は試合中変わらないので, 試合で最初に
+    /// 使うときに作る
+    struct CostTables {
+        int m;
+        /// work_one[w]: clamp(round(N(w, w / 3)), 1, 10000)
+        sampler::DiscreteCdf work_one[51];
+        /// work_all[w]: clamp(round(N(w * m, w * m / 3)), 1, 10000)
+        sampler::DiscreteCdf work_all[51];
+
+        CostTables(int m) : m(m) {
+            for (int w = 1; w <= 50; ++w) {
+                work_one[w] = sampler::rounded_gauss(w, w / 3.0, 1, 10000);
+                work_all[w] =
+                    sampler::rounded_gauss(w * m, w * m / 3.0, 1, 10000);
+            }
+        }
+    };
+
+    static const CostTables& cost_tables() {
+        static GAME_LOCAL optional<CostTables> tables;
+        if (!tables || tables->m != input::field.m) {
+            tables.emplace(input::field.m);
+        }
+        return *tables;
+    }
 
+    void set_weights(const double w[5]) { type_table.build(w); }
+
+    /// @brief [0, 1) の一様乱数 (53bit)
+    static inline double uniform() { return xorshift::getDouble(); }
+
+    /// @brief 標準正規分布 (ziggurat 法)
+    static inline double normal() { return xorshift::getNormal(); }
+
+    /// @brief h = round(2^b), v = round(2^clamp(b + N(0, 0.5), 0, 10))
+    /// 丸めは問題文 (と src/judge.hpp) に合わせて四捨五入にする
     Mountain generate_mountain(int scale) {
-        const int base = 1 << scale;
         Mountain ret;
-        double b   = xorshift::getDouble(2.0, 8.0);
-        ret.height = int64_t(pow(2, b)) * base;
-        ret.value  =                                       //
-            int64_t(                                       //
-                pow(                                       //
-                    2,                                     //
-                    clamp_double(                          //
-                        xorshift::gauss(b, 0.5), 0.0, 10.0 //
-                        )                                  //
-                    )                                      //
-                )                                          //
-            * base;
+        const double b = 2.0 + 6.0 * uniform();
+        ret.height     = llround(exp2(b)) << scale;
+        ret.value =
+            llround(exp2(clamp_double(b + 0.5 * normal(), 0.0, 10.0)))
+            << scale;
         return ret;
     }
 
     C generate_card(int scale, int m) {
-        const int base = 1 << scale;
-        double r       = xorshift::getDouble();
+        const CostTables& tables = cost_tables();
+        assert(tables.m == m);
+        (void)m;
         C ret;
-        if (r < w[0]) {
-            const int64_t w_dash = xorshift::getInt(1, 50);
-            ret.type             = WORK_ONE;
-            ret.work_amount      = w_dash * base;
-            ret.cost =
-                clamp(round(xorshift::gauss(w_dash, w_dash / 3.0)), 1, 10000)
-                * base;
-            return ret;
-        }
-        r -= w[0];
-        if (r < w[1]) {
-            const int64_t w_dash = xorshift::getInt(1, 50);
-            ret.type             = WORK_ALL;
-            ret.work_amount      = w_dash * base;
-            ret.cost =
-                clamp(round(xorshift::gauss(w_dash * m, w_dash * m / 3.0)), 1,
-                      10000)
-                * base;
-            return ret;
-        }
-        r -= w[1];
-        if (r < w[2]) {
-            ret.type        = DELETE_ONE;
-            ret.work_amount = 0;
-            ret.cost        = xorshift::getInt(0, 10) * base;
-            return ret;
-        }
-        r -= w[2];
-        if (r < w[3]) {
-            ret.type        = DELETE_ALL;
-            ret.work_amount = 0;
-            ret.cost        = xorshift::getInt(0, 10) * base;
-            return ret;
-        }
-        ret.type        = SCALE_UP;
-        ret.work_amount = 0;
-        ret.cost        = xorshift::getInt(200, 1000) * base;
+        ret.type = CardType(type_table.sample(xorshift::getUint()));
+        switch (ret.type) {
+            case WORK_ONE: {
+                const int w_dash = xorshift::getInt(1, 50);
+                ret.work_amount  = int64_t(w_dash) << scale;
+                ret.cost = tables.work_one[w_dash].sample(uniform()) << scale;
+                break;
+            }
+            case WORK_ALL: {
+                const int w_dash = xorshift::getInt(1, 50);
+                ret.work_amount  = int64_t(w_dash) << scale;
+                ret.cost = tables.work_all[w_dash].sample(uniform()) << scale;
+                break;
+            }
+            case DELETE_ONE:
+            case DELETE_ALL:
+                ret.work_amount = 0;
+                ret.cost        = xorshift::getInt(0, 10) << scale;
+                break;
+            case SCALE_UP:
+                ret.work_amount = 0;
+                ret.cost        = xorshift::getInt(200, 1000) << scale;
+                break;
+            default:
+                assert(false);
+        }
         return ret;
     }
 
@@ -213,73 +387,69 @@ struct InputGenerator {
 };
 
 
-std::chrono::high_resolution_clock::time_point start_time;
 
-pair<int, int> use_card_greedy(Hand& h, Field& f, int64_t current_money,
-                               int current_scale) {
-    (void)current_money;
-    (void)current_scale;
-    static vector<pair<int64_t, int>> work_one_pos;
-    static vector<pair<int64_t, int>> work_all_pos;
-    static vector<int> delete_one_pos;
-    static vector<int> delete_all_pos;
-    static vector<int> scale_up_pos;
-
-    work_one_pos.clear();
-    work_all_pos.clear();
-    delete_one_pos.clear();
-    delete_all_pos.clear();
-    scale_up_pos.clear();
+/// @brief 手札の位置を種類ごとにまとめた索引
+/// WORK_ONE / WORK_ALL は (労働力, 位置) の昇順, それ以外は位置の昇順に並べる
+/// 1 枚入れ替えるときは erase / insert で差分だけ更新する
+struct HandIndex {
+    FixedVector<int, N_UB> pos[CARD_TYPE_NUM];
 
-    for (int i = 0; i < h.n; ++i) {
-        switch (h.cards[i].type) {
-            case WORK_ONE:
-                work_one_pos.emplace_back(h.cards[i].work_amount, i);
-                break;
-            case WORK_ALL:
-                work_all_pos.emplace_back(h.cards[i].work_amount, i);
-                break;
-            case DELETE_ONE:
-                delete_one_pos.emplace_back(i);
-                break;
-            case DELETE_ALL:
-                delete_all_pos.emplace_back(i);
-                break;
-            case SCALE_UP:
-                if (current_scale < 20) scale_up_pos.emplace_back(i);
-                break;
-            default:
-                assert(false);
-        }
+    void build(const Hand& h) {
+        for (auto& p : pos) p.clear();
+        for (int i = 0; i < h.n; ++i) insert(h, i);
     }
-    sort(work_one_pos.begin(), work_one_pos.end(), [&](auto& a, auto& b) {
-        return h.cards[a.second].work_amount < h.cards[b.second].work_amount;
-    });
-    sort(work_all_pos.begin(), work_all_pos.end(), [&](auto& a, auto& b) {
-        return h.cards[a.second].work_amount < h.cards[b.second].work_amount;
-    });
 
-    // SCALE_UP があるときは SCALE_UPを選ぶ
-    if (scale_up_pos.size() > 0u) {
-        return {scale_up_pos[0], 0};
+    /// @brief h.cards[i] を書き換える前に呼ぶ
+    inline void erase(const Hand& h, int i) {
+        auto& p = pos[h.cards[i].type];
+        int j   = 0;
+        while (p[j] != i) j++;
+        p.erase(j);
     }
 
+    /// @brief h.cards[i] を書き換えた後に呼ぶ
+    inline void insert(const Hand& h, int i) {
+        const auto& card = h.cards[i];
+        auto& p          = pos[card.type];
+        const bool work  = card.type == WORK_ONE || card.type == WORK_ALL;
+        int j            = p.size();
+        while (j > 0) {
+            const auto& prev = h.cards[p[j - 1]];
+            const bool less =
+                work && card.work_amount != prev.work_amount
+                    ? card.work_amount < prev.work_amount
+                    : i < p[j - 1];
+            if (!less) break;
+            j--;
+        }
+        p.insert(j, i);
+    }
+};
 
-    int best_mt_pos  = 0;
-    int worst_mt_pos = 0;
-    for (int i = 1; i < f.m; ++i) {
-        double pf = f.mountains[i].value / (double)f.mountains[i].height;
+/// @tparam M 0 以外なら山の数をコンパイル時定数として使う (0 なら f.m)
+template <int M = 0>
+pair<int, int> use_card_greedy(const Hand& h, const HandIndex& index,
+                               Field& f, int64_t current_money,
+                               int current_scale) {
+    (void)current_money;
+    const int m                = M ? M : f.m;
+    const auto& work_one_pos   = index.pos[WORK_ONE];
+    const auto& work_all_pos   = index.pos[WORK_ALL];
+    const auto& delete_one_pos = index.pos[DELETE_ONE];
+    const auto& delete_all_pos = index.pos[DELETE_ALL];
+    const auto& scale_up_pos   = index.pos[SCALE_UP];
+    auto amount = [&](int pos) { return h.cards[pos].work_amount; };
 
-        if (pf > f.mountains[best_mt_pos].value
-                     / (double)f.mountains[best_mt_pos].height) {
-            best_mt_pos = i;
-        }
-        if (pf < f.mountains[worst_mt_pos].value
-                     / (double)f.mountains[worst_mt_pos].height) {
-            worst_mt_pos = i;
-        }
+    // SCALE_UP があるときは SCALE_UPを選ぶ
+    if (current_scale < 20 && scale_up_pos.size() > 0u) {
+        return {scale_up_pos[0], 0};
     }
 
+    assert(f.live == f.all_mask());
+    f.refresh_order();
+    const int best_mt_pos  = f.best_pos;
+    const int worst_mt_pos = f.worst_pos;
+
     // 働く場合の効率を先に計算する
     int64_t work_profit = 0;
     CardType work_type  = WORK_ONE;
@@ -287,31 +457,31 @@ pair<int, int> use_card_greedy(Hand& h, Field& f, int64_t current_money,
     {
         int64_t max_work = 0;
         if (work_all_pos.size() > 0u) {
-            const auto cap = work_all_pos.back().first;
+            const auto cap = amount(work_all_pos.back());
             int64_t work   = 0;
-            for (int i = 0; i < f.m; ++i) {
+            for (int i = 0; i < m; ++i) {
                 work += min(cap, f.mountains[i].height);
             }
             if (work > max_work) {
                 work_type = WORK_ALL;
-                work_pos  = work_all_pos.back().second;
+                work_pos  = work_all_pos.back();
                 max_work  = work;
             }
         }
         if (work_one_pos.size() > 0u) {
-            const auto cap = work_one_pos.back().first;
+            const auto cap = amount(work_one_pos.back());
             int work       = min(cap, f.mountains[best_mt_pos].height);
             if (work > max_work) {
                 work_type = WORK_ONE;
-                work_pos  = work_one_pos.back().second;
+                work_pos  = work_one_pos.back();
                 max_work  = work;
             }
         }
 
         if (work_pos != -1) {
             if (work_type == WORK_ALL) {
-                for (int i = 0; i < f.m; ++i) {
-                    if (f.mountains[i].height <= work_all_pos.back().first) {
+                for (int i = 0; i < m; ++i) {
+                    if (f.mountains[i].height <= amount(work_all_pos.back())) {
                         work_profit += f.mountains[i].value;
                     }
                 }
@@ -320,12 +490,12 @@ pair<int, int> use_card_greedy(Hand& h, Field& f, int64_t current_money,
                 int p = work_one_pos.size() - 1;
                 // 労働力が過剰なときは弱いカードを選ぶ
                 while (p > 0) {
-                    if (work_one_pos[p - 1].first
+                    if (amount(work_one_pos[p - 1])
                         >= f.mountains[best_mt_pos].height) {
                         p--;
                     }
                     else {
-                        const auto over = work_one_pos[p].first
+                        const auto over = amount(work_one_pos[p])
                                           - f.mountains[best_mt_pos].height;
                         if (over
                             <= (1 << current_scale) * OVER_THRESHOLD_RATE) {
@@ -334,10 +504,11 @@ pair<int, int> use_card_greedy(Hand& h, Field& f, int64_t current_money,
                         p--;
                     }
                 }
-                work_pos = work_one_pos[p].second;
-            }
-            if (f.mountains[best_mt_pos].height <= work_one_pos.back().first) {
-                work_profit += f.mountains[best_mt_pos].value;
+                work_pos = work_one_pos[p];
+                if (f.mountains[best_mt_pos].height
+                    <= amount(work_one_pos.back())) {
+                    work_profit += f.mountains[best_mt_pos].value;
+                }
             }
         }
     }
@@ -350,9 +521,9 @@ pair<int, int> use_card_greedy(Hand& h, Field& f, int64_t current_money,
     const double delete_one_threshold_rate = DELETE_ONE_THRESHOLD_RATE;
 
     if (delete_one_pos.size() > 0u) {
-        double pf = f.mountains[worst_mt_pos].value
-                    / (double)f.mountains[worst_mt_pos].height;
-        if (pf < delete_one_threshold_rate) {
+        // value / height < rate を割らずに比べる (BatchEstimator と揃える)
+        const auto& worst = f.mountains[worst_mt_pos];
+        if (worst.value < worst.height * delete_one_threshold_rate) {
             return {delete_one_pos[0], worst_mt_pos};
         }
     }
@@ -373,96 +544,83 @@ pair<int, int> use_card_greedy(Hand& h, Field& f, int64_t current_money,
     return {0, 0};
 }
 
-vector<int> filter_next_cards(const NextCards& nc, int64_t current_money,
-                              int current_scale) {
-    static vector<int> work_one_pos;
-    static vector<int> work_all_pos;
-    static vector<int> delete_one_pos;
-    static vector<int> delete_all_pos;
-    static vector<int> scale_up_pos;
-    work_one_pos.clear();
-    work_all_pos.clear();
-    delete_one_pos.clear();
-    delete_all_pos.clear();
-    scale_up_pos.clear();
-
-    for (int i = 0; i < nc.k; ++i) {
+pair<int, int> use_card_greedy(const Hand& h, Field& f,
+                               int64_t current_money, int current_scale) {
+    HandIndex index;
+    index.build(h);
+    return use_card_greedy(h, index, f, current_money, current_scale);
+}
+
+/// @brief 補充候補の位置の列. 高々 K_UB 個なのでヒープを使わない
+using CardPositions = FixedVector<int, K_UB>;
+
+/// @tparam K 0 以外なら補充候補の数をコンパイル時定数として使う (0 なら nc.k)
+template <int K = 0>
+CardPositions filter_next_cards(const NextCards& nc, int64_t current_money,
+                                int current_scale) {
+    // ロールアウトの各ターンからも呼ばれるので回数だけを数える
+    PROBE_COUNT("filter_next_cards");
+    // WORK_ONE / WORK_ALL はコスト昇順に見て労働力が増えるものだけ残す
+    CardPositions work_one_pos;
+    CardPositions work_all_pos;
+    int64_t work_one_last = -1;
+    int64_t work_all_last = -1;
+    int delete_one_pos = -1;
+    int delete_all_pos = -1;
+    int scale_up_pos   = -1;
+    const int k        = K ? K : nc.k;
+
+    for (int i = 0; i < k; ++i) {
         if (nc.cards[i].cost > current_money) continue;
         switch (nc.cards[i].type) {
             case WORK_ONE:
-                work_one_pos.emplace_back(i);
+                if (nc.cards[i].work_amount > work_one_last) {
+                    work_one_pos.push_back(i);
+                    work_one_last = nc.cards[i].work_amount;
+                }
                 break;
             case WORK_ALL:
-                work_all_pos.emplace_back(i);
+                if (nc.cards[i].work_amount > work_all_last) {
+                    work_all_pos.push_back(i);
+                    work_all_last = nc.cards[i].work_amount;
+                }
                 break;
             case DELETE_ONE:
-                if (delete_one_pos.empty()) delete_one_pos.emplace_back(i);
+                if (delete_one_pos == -1) delete_one_pos = i;
                 break;
             case DELETE_ALL:
-                if (delete_all_pos.empty()) delete_all_pos.emplace_back(i);
+                if (delete_all_pos == -1) delete_all_pos = i;
                 break;
             case SCALE_UP:
-                if (current_scale < 20 && scale_up_pos.empty())
-                    scale_up_pos.emplace_back(i);
+                if (current_scale < 20 && scale_up_pos == -1) scale_up_pos = i;
                 break;
             default:
                 assert(false);
         }
     }
-    if (work_one_pos.size() > 0u) {
-        static vector<int> work_one_pos_tmp;
-        work_one_pos_tmp.clear();
-        work_one_pos_tmp.emplace_back(work_one_pos[0]);
-        for (int i = 1; i < (int)work_one_pos.size(); ++i) {
-            if (nc.cards[work_one_pos_tmp.back()].work_amount
-                < nc.cards[work_one_pos[i]].work_amount) {
-                work_one_pos_tmp.emplace_back(work_one_pos[i]);
-            }
-        }
-        swap(work_one_pos, work_one_pos_tmp);
-    }
-    if (work_all_pos.size() > 0u) {
-        static vector<int> work_all_pos_tmp;
-        work_all_pos_tmp.clear();
-        work_all_pos_tmp.emplace_back(work_all_pos[0]);
-        for (int i = 1; i < (int)work_all_pos.size(); ++i) {
-            if (nc.cards[work_all_pos_tmp.back()].work_amount
-                < nc.cards[work_all_pos[i]].work_amount) {
-                work_all_pos_tmp.emplace_back(work_all_pos[i]);
-            }
-        }
-        swap(work_all_pos, work_all_pos_tmp);
-    }
-    static vector<int> ret;
-    ret.clear();
-    ret.insert(ret.end(), work_one_pos.begin(), work_one_pos.end());
-    ret.insert(ret.end(), work_all_pos.begin(), work_all_pos.end());
-    ret.insert(ret.end(), delete_one_pos.begin(), delete_one_pos.end());
-    ret.insert(ret.end(), delete_all_pos.begin(), delete_all_pos.end());
-    ret.insert(ret.end(), scale_up_pos.begin(), scale_up_pos.end());
+    CardPositions ret = work_one_pos;
+    for (int i : work_all_pos) ret.push_back(i);
+    if (delete_one_pos != -1) ret.push_back(delete_one_pos);
+    if (delete_all_pos != -1) ret.push_back(delete_all_pos);
+    if (scale_up_pos != -1) ret.push_back(scale_up_pos);
     return ret;
 }
 
-int pick_card_greedy(const Hand& h, const NextCards& nc, int64_t current_money,
+/// @brief 労働力 work のカードがコスト cost に見合うか
+/// (work / (cost + 0.01) >= 1.3 を整数の掛け算で判定する)
+/// Ofast では浮動小数点の割り算の比較がビルドや展開のされ方で揺れ,
+/// Estimator と BatchEstimator の選ぶカードが食い違うので使わない
+inline bool worth_work(int64_t work, int64_t cost) {
+    return work * 1000 >= cost * 1300 + 13;
+}
+
+template <int M = 0, int K = 0>
+int pick_card_greedy(const NextCards& nc, int64_t current_money,
                      int current_scale, int turn) {
-    int own_delete_one = 0;
-    for (int i = 0; i < h.n; ++i) {
-        switch (h.cards[i].type) {
-            case WORK_ONE:
-            case WORK_ALL:
-            case DELETE_ALL:
-            case SCALE_UP:
-                break;
-            case DELETE_ONE:
-                own_delete_one++;
-                break;
-            default:
-                assert(false);
-        }
-    }
-    static vector<int> candidates;
-    candidates.clear();
-    auto filtered_pos = filter_next_cards(nc, current_money, current_scale);
+    const int m = M ? M : input::field.m;
+    CardPositions candidates;
+    const auto filtered_pos =
+        filter_next_cards<K>(nc, current_money, current_scale);
     for (int i : filtered_pos) {
         // ターンによる減衰率
         const double decay_rate = min(1.0, (T - turn) / 200.0);
@@ -470,26 +628,23 @@ int pick_card_greedy(const Hand& h, const NextCards& nc, int64_t current_money,
             current_money * GREEDY_PICK_WORK_THRESHOLD;
         const int64_t delete_one_threshold =
             current_money * GREEDY_PICK_DELETE_ONE_THRESHOLD;
+        // 率を先に掛け合わせ, 所持金との積を 1 回の丸めにする
+        const double scale_up_rate =
+            scale_up_rate_by_current_money[current_scale] * decay_rate;
         const int64_t scale_up_threshold =
-            min(current_money * scale_up_rate_by_current_money[current_scale]
-                    * decay_rate,
+            min(current_money * scale_up_rate,
                 (int64_t(1) << current_scale) * 500.0);
-        double pf;
-        constexpr double work_one_pf_threshold = 1.3;
-        constexpr double work_all_pf_threshold = 1.3;
         switch (nc.cards[i].type) {
             case WORK_ONE:
-                pf = nc.cards[i].work_amount / double(nc.cards[i].cost + 0.01);
                 if (nc.cards[i].cost <= work_card_threshold
-                    && pf >= work_one_pf_threshold) {
+                    && worth_work(nc.cards[i].work_amount, nc.cards[i].cost)) {
                     candidates.emplace_back(i);
                 }
                 break;
             case WORK_ALL:
-                pf = nc.cards[i].work_amount * input::field.m
-                     / double(nc.cards[i].cost + 0.01);
                 if (nc.cards[i].cost <= work_card_threshold
-                    && pf >= work_all_pf_threshold) {
+                    && worth_work(nc.cards[i].work_amount * m,
+                                  nc.cards[i].cost)) {
                     candidates.emplace_back(i);
                 }
                 break;
@@ -524,7 +679,7 @@ int pick_card_greedy(const Hand& h, const NextCards& nc, int64_t current_money,
         int64_t best_work = -INF;
         for (int cand_pos : candidates) {
             if (nc.cards[cand_pos].type == WORK_ONE) {
-                const double pf =
+                const int64_t pf =
                     nc.cards[cand_pos].work_amount - nc.cards[cand_pos].cost;
                 if (pf > best_work) {
                     best_work_card_pos = cand_pos;
@@ -532,8 +687,8 @@ int pick_card_greedy(const Hand& h, const NextCards& nc, int64_t current_money,
                 }
             }
             else if (nc.cards[cand_pos].type == WORK_ALL) {
-                const double pf =
-                    nc.cards[cand_pos].work_amount * input::field.m
+                const int64_t pf =
+                    nc.cards[cand_pos].work_amount * m
                     - nc.cards[cand_pos].cost;
                 if (pf > best_work) {
                     best_work_card_pos = cand_pos;
@@ -541,48 +696,39 @@ int pick_card_greedy(const Hand& h, const NextCards& nc, int64_t current_money,
                 }
             }
             else if (nc.cards[cand_pos].type == DELETE_ONE) {
-                const double pf =
-                    (1 << current_scale) * 0.5 - nc.cards[cand_pos].cost;
-                if (pf > best_work) {
+                // 利益 2^scale / 2 - cost を 2 倍して整数で比べる
+                const int64_t pf2 =
+                    (1 << current_scale) - 2 * nc.cards[cand_pos].cost;
+                if (pf2 > 2 * best_work) {
                     best_work_card_pos = cand_pos;
-                    best_work          = pf;
+                    best_work          = pf2 / 2;
                 }
             }
         }
     }
 
     return best_work_card_pos;
-
-    assert(nc.cards[0].cost == 0 && nc.cards[0].type == WORK_ONE);
-    return candidates[0]; // コスト 0 の WORK_ONE が入るはず
 }
 
 void update_field(Field& f, const C& card, int mountain_pos,
                   int64_t& current_money, int& current_scale) {
     switch (card.type) {
         case WORK_ONE:
-            f.mountains[mountain_pos].height -= card.work_amount;
-            if (f.mountains[mountain_pos].height <= 0) {
-                current_money += f.mountains[mountain_pos].value;
-                f.mountains[mountain_pos].value = ERASED;
-            }
+            current_money += f.work(mountain_pos, card.work_amount);
             break;
         case WORK_ALL:
-            for (int i = 0; i < f.m; ++i) {
-                f.mountains[i].height -= card.work_amount;
-                if (f.mountains[i].height <= 0) {
-                    current_money += f.mountains[i].value;
-                    f.mountains[i].value = ERASED;
-                }
+            // 全部の比が変わるので順位は後でまとめて作り直す
+            f.order_dirty = true;
+            for (uint32_t rest = f.live; rest; rest &= rest - 1) {
+                current_money += f.work(__builtin_ctz(rest), card.work_amount);
             }
             break;
         case DELETE_ONE:
-            f.mountains[mountain_pos].value = ERASED;
+            f.erase(mountain_pos);
             break;
         case DELETE_ALL:
-            for (int i = 0; i < f.m; ++i) {
-                f.mountains[i].value = ERASED;
-            }
+            f.live        = 0;
+            f.order_dirty = true;
             break;
         case SCALE_UP:
             current_scale++;
@@ -592,103 +738,1045 @@ void update_field(Field& f, const C& card, int mountain_pos,
     }
 }
 
-struct Estimator {
-    vector<NextCards> future_cards;
-    InputGenerator input_generator;
+/// @brief 補充候補の重みを freq から推定する. サンプルが少ないうちは PROB_MEAN に寄せる
+void normalized_weights(const int64_t freq[5], double w[5]) {
+    double x[5];
+    double tot = 0.001;
+    for (int i = 0; i < 5; ++i) {
+        x[i] = freq[i];
+        tot += x[i];
+    }
+    const double p = min(1.0, tot / double(PROBABILITY_SAMPLES));
 
-    Estimator(int current_turn, int last_turn, double x0, double x1, double x2,
-              double x3, double x4) {
-        double tot = x0 + x1 + x2 + x3 + x4 + 0.001;
-        double p   = min(1.0, tot / double(PROBABILITY_SAMPLES));
+    double sum = 0;
+    for (int i = 0; i < 5; ++i) {
+        x[i] = p * x[i] / tot + (1.0 - p) * PROB_MEAN[i];
+        sum += x[i];
+    }
+    for (int i = 0; i < 5; ++i) {
+        w[i] = x[i] / sum;
+    }
+}
 
-        x0  = p * x0 / tot + (1.0 - p) * PROB_MEAN[0];
-        x1  = p * x1 / tot + (1.0 - p) * PROB_MEAN[1];
-        x2  = p * x2 / tot + (1.0 - p) * PROB_MEAN[2];
-        x3  = p * x3 / tot + (1.0 - p) * PROB_MEAN[3];
-        x4  = p * x4 / tot + (1.0 - p) * PROB_MEAN[4];
-        tot = x0 + x1 + x2 + x3 + x4;
+/// @brief シナリオが保持できるターン数. シミュレーションのターン数より大きい 2 冪
+constexpr int SCENARIO_RING_SIZE = 64;
 
-        input_generator.w[0] = x0 / tot;
-        input_generator.w[1] = x1 / tot;
-        input_generator.w[2] = x2 / tot;
-        input_generator.w[3] = x3 / tot;
-        input_generator.w[4] = x4 / tot;
-        future_cards.resize(last_turn - current_turn + 1);
-        input_generator.generate_cards(last_turn - current_turn + 1,
-                                       future_cards.data());
+/// @brief ロールアウトの本数 (ターンごとに logger に積む)
+GAME_LOCAL logger::Counter rollout_counter;
+
+struct Estimator {
+    /// future_cards[t & (SCENARIO_RING_SIZE - 1)] がターン t の補充候補
+    /// future_mountains[t & (SCENARIO_RING_SIZE - 1)][i] がターン t に山 i
+    /// が消えたときに補充される山 (scale = 0)
+    /// どの arm も同じシナリオでは同じカード・同じ山を見る
+    /// [begin_turn, end_turn) の範囲が生成済み
+    NextCards future_cards[SCENARIO_RING_SIZE];
+    Mountain future_mountains[SCENARIO_RING_SIZE][M_UB];
+    int begin_turn = 0;
+    int end_turn   = 0;
+    InputGenerator input_generator;
+
+    /// @brief [first_turn, last_turn) の補充候補が揃うように古いターンを捨てて末尾を生成する
+    void advance(int first_turn, int last_turn) {
+        assert(last_turn - first_turn <= SCENARIO_RING_SIZE);
+        if (first_turn < begin_turn || first_turn > end_turn) {
+            end_turn = first_turn;
+        }
+        begin_turn = first_turn;
+        for (; end_turn < last_turn; ++end_turn) {
+            const int pos = end_turn & (SCENARIO_RING_SIZE - 1);
+            input_generator.generate_cards(1, &future_cards[pos]);
+            for (int i = 0; i < input::field.m; ++i) {
+                future_mountains[pos][i] = input_generator.generate_mountain(0);
+            }
+        }
     }
 
+    /// @brief 生成済みのターンを捨てる
+    void clear() { begin_turn = end_turn = 0; }
+
+    /// @tparam M, K 0 以外なら山の数・補充候補の数をコンパイル時定数として使う
+    /// @param mid_turn, mid_out last_turn を mid_turn にしたときの評価値を
+    /// *mid_out に書く (同じロールアウトの途中経過なので追加の手間はない)
+    template <int M = 0, int K = 0>
     double estimate(int current_turn, int last_turn, int64_t current_money,
-                    int current_scale, const Hand& hand_, const Field& field_) {
+                    int current_scale, const Hand& hand_, const Field& field_,
+                    int mid_turn = -1, double* mid_out = nullptr) {
         Hand h;
         h.n = hand_.n;
         for (int i = 0; i < h.n; ++i) {
             h.cards[i].type        = hand_.cards[i].type;
             h.cards[i].work_amount = hand_.cards[i].work_amount;
         }
-        Field f;
-        f.m = field_.m;
-        for (int i = 0; i < f.m; ++i) {
-            f.mountains[i].height = field_.mountains[i].height;
-            f.mountains[i].value  = field_.mountains[i].value;
-        }
+#ifdef BENCH
+        bench::RolloutTimer timer(1, last_turn - current_turn);
+#endif
+        PROBE_SCOPE("estimate");
+        rollout_counter.add(1);
+        HandIndex index;
+        index.build(h);
+        const int m = M ? M : field_.m;
+        const int k = K ? K : input::next_cards.k;
+        Field f = field_;
 
         for (int turn = current_turn; turn < last_turn; ++turn) {
             auto [use_pos, mountain_pos] =
-                use_card_greedy(h, f, current_money, current_scale);
+                use_card_greedy<M>(h, index, f, current_money, current_scale);
             update_field(f, h.cards[use_pos], mountain_pos, current_money,
                          current_scale);
             // assert(current_scale <= 20);
+            if (turn + 1 == mid_turn) {
+                *mid_out = current_money
+                           + C1 * (T - mid_turn) * (1 << current_scale);
+            }
             if (turn < T - 1) {
-                for (int i = 0; i < f.m; ++i) {
-                    if (f.mountains[i].value == ERASED) {
-                        f.mountains[i] =
-                            input_generator.generate_mountain(current_scale);
-                    }
-                }
-
-                static NextCards nc;
-                nc.k = future_cards[turn - current_turn].k;
-                for (int i = 0; i < nc.k; ++i) {
-                    nc.cards[i] = future_cards[turn - current_turn].cards[i];
-                    nc.cards[i].cost <<= current_scale;
-                    nc.cards[i].work_amount <<= current_scale;
-                }
-                auto pick_pos =
-                    pick_card_greedy(h, nc, current_money, current_scale, turn);
-                current_money -= nc.cards[pick_pos].cost;
-                h.cards[use_pos] = nc.cards[pick_pos];
+                refill_and_pick<M, K>(turn, m, k, h, index, use_pos, f,
+                                      current_money, current_scale);
             }
         }
         return current_money + C1 * (T - last_turn) * (1 << current_scale);
         // return current_money;
     }
+
+    /// @brief current_turn に手札 use_pos を山 mountain_pos に使ってから
+    /// estimate と同じロールアウトを last_turn まで行う
+    /// 山の補充と current_turn の補充候補もシナリオから決めるので,
+    /// シナリオは current_turn から生成しておくこと
+    double estimate_after_use(int current_turn, int last_turn,
+                              int64_t current_money, int current_scale,
+                              const Hand& hand_, const Field& field_,
+                              int use_pos, int mountain_pos) {
+        Hand h = hand_;
+        HandIndex index;
+        index.build(h);
+        Field f = field_;
+        update_field(f, h.cards[use_pos], mountain_pos, current_money,
+                     current_scale);
+        if (current_turn < T - 1) {
+            refill_and_pick(current_turn, f.m, input::next_cards.k, h, index,
+                            use_pos, f, current_money, current_scale);
+        }
+        return estimate(current_turn + 1, last_turn, current_money,
+                        current_scale, h, f);
+    }
+
+  private:
+    /// @brief turn に消えた山をシナリオの山で埋め, シナリオの補充候補から
+    /// 貪欲に選んだカードを手札 use_pos に入れる
+    template <int M = 0, int K = 0>
+    inline void refill_and_pick(int turn, int m, int k, Hand& h,
+                                HandIndex& index, int use_pos, Field& f,
+                                int64_t& current_money, int current_scale) {
+        const int pos           = turn & (SCENARIO_RING_SIZE - 1);
+        const uint32_t all_mask = (1u << m) - 1;
+        for (uint32_t dead = ~f.live & all_mask; dead; dead &= dead - 1) {
+            const int i    = __builtin_ctz(dead);
+            const auto& mt = future_mountains[pos][i];
+            f.put(i, {mt.height << current_scale, mt.value << current_scale});
+        }
+
+        NextCards nc;
+        const auto& fc = future_cards[pos];
+        nc.k           = k;
+        for (int i = 0; i < k; ++i) {
+            nc.cards[i] = fc.cards[i];
+            nc.cards[i].cost <<= current_scale;
+            nc.cards[i].work_amount <<= current_scale;
+        }
+        auto pick_pos =
+            pick_card_greedy<M, K>(nc, current_money, current_scale, turn);
+        current_money -= nc.cards[pick_pos].cost;
+        index.erase(h, use_pos);
+        h.cards[use_pos] = nc.cards[pick_pos];
+        index.insert(h, use_pos);
+    }
 };
 
-int64_t total_ms_pick_card = 0;
-int64_t pick_card_call_num = 0;
-double avg_ms_pick_card    = 1;
+/// @brief |x| < 2^51 の整数を double に変換する
+/// 仮数部に直接足し込むので AVX2 でもベクトル化できる
+inline double exact_double(int64_t x) {
+    return bit_cast<double>(x + 0x4338000000000000ll) - 0x1.8p52;
+}
+
+/// @brief BatchEstimator が同時に進めるシナリオの数
+constexpr int BATCH_LANES = 8;
 
-int pick_card(const Hand& h_, int used_pos, const Field& f, const NextCards& nc,
-              int64_t current_money, int current_scale, int turn,
-              int64_t freq[5]) {
-    using namespace std::chrono;
-    auto now        = high_resolution_clock::now();
-    auto candidates = filter_next_cards(nc, current_money, current_scale);
-    if (candidates.size() == 1u) {
-        return candidates[0];
-    }
-    const int turns     = input::next_cards.k <= 2 ? 50 : 30;
+/// @brief scale ごとの rate * 2^scale (整数と比べるので切り捨てる)
+constexpr array<int64_t, 21> threshold_by_scale(double rate) {
+    array<int64_t, 21> ret{};
+    for (int s = 0; s <= 20; ++s) {
+        ret[s] = (1 << s) * rate;
+    }
+    return ret;
+}
+
+#ifdef TUNING
+/// @brief TUNING ビルドでの BatchEstimator::over_threshold_by_scale の実体
+/// テンプレートの静的メンバは動的な初期化の順序が決まらないので,
+/// 実行時に決まる OVER_THRESHOLD_RATE から作る表は名前空間に置く
+const array<int64_t, 21> tuned_over_threshold_by_scale =
+    threshold_by_scale(OVER_THRESHOLD_RATE);
+#endif
+
+/// @brief 複数のシナリオを同時に進めるロールアウト
+/// 状態はレーン (シナリオ) を最内の添字にした SoA で持ち,
+/// 1 ターンの処理をレーンごとのマスクと select の列として書いて
+/// レーン方向にベクトル化させる
+/// 各レーンの結果は同じシナリオでの Estimator::estimate と一致する
+/// (make kernel-check で確かめる). Ofast でも揺れないように, 閾値との比較は
+/// 整数か, 両辺とも 1 回の丸めで済む形で書く
+/// 手札・山・補充候補の数 N, M, K は 0 以外ならコンパイル時定数として
+/// ループを展開させ, 0 なら estimate に渡された実行時の値を使う
+template <int N, int M, int K>
+struct BatchEstimator {
+    constexpr static int LANES = BATCH_LANES;
+    constexpr static int N_CAP = N ? N : N_UB;
+    constexpr static int M_CAP = M ? M : M_UB;
+    constexpr static int K_CAP = K ? K : K_UB;
+    int n = N, m = M, k = K;
+
+    alignas(64) int64_t height[M_CAP][LANES];
+    alignas(64) int64_t value[M_CAP][LANES];
+    alignas(64) int64_t erased[M_CAP][LANES];
+    alignas(64) int64_t hand_type[N_CAP][LANES];
+    alignas(64) int64_t hand_amount[N_CAP][LANES];
+    alignas(64) int64_t next_type[K_CAP][LANES];
+    alignas(64) int64_t next_amount[K_CAP][LANES];
+    alignas(64) int64_t next_cost[K_CAP][LANES];
+    alignas(64) int64_t money[LANES];
+    alignas(64) int64_t scale[LANES];
+    alignas(64) int64_t over_threshold[LANES];
+    alignas(64) int64_t use_pos[LANES];
+    alignas(64) int64_t mountain_pos[LANES];
+
+    inline int hand_num() const { return N ? N : n; }
+    inline int mountain_num() const { return M ? M : m; }
+    inline int next_num() const { return K ? K : k; }
+
+    /// @brief scale ごとの OVER_THRESHOLD_RATE * 2^scale
+#ifdef TUNING
+    inline static const array<int64_t, 21>& over_threshold_by_scale =
+        tuned_over_threshold_by_scale;
+#else
+    constexpr static array<int64_t, 21> over_threshold_by_scale =
+        threshold_by_scale(OVER_THRESHOLD_RATE);
+#endif
+
+    /// @brief use_card_greedy のレーン版
+    void use_card_greedy() {
+        // value / height の比較は Field と同じく整数の掛け算で行う
+        alignas(64) int64_t best[LANES], worst[LANES];
+        alignas(64) int64_t best_h[LANES], best_v[LANES];
+        alignas(64) int64_t worst_h[LANES], worst_v[LANES];
+        for (int l = 0; l < LANES; ++l) {
+            best[l]   = 0;
+            worst[l]  = 0;
+            best_h[l] = worst_h[l] = height[0][l];
+            best_v[l] = worst_v[l] = value[0][l];
+        }
+        for (int i = 1; i < mountain_num(); ++i) {
+            for (int l = 0; l < LANES; ++l) {
+                const int64_t h   = height[i][l];
+                const int64_t v   = value[i][l];
+                const bool better = v * best_h[l] > best_v[l] * h;
+                const bool worse  = worst_v[l] * h > v * worst_h[l];
+                best[l]           = better ? i : best[l];
+                best_h[l]         = better ? h : best_h[l];
+                best_v[l]         = better ? v : best_v[l];
+                worst[l]          = worse ? i : worst[l];
+                worst_h[l]        = worse ? h : worst_h[l];
+                worst_v[l]        = worse ? v : worst_v[l];
+            }
+        }
+
+        // 種類ごとの先頭の位置と, WORK_ALL / WORK_ONE の労働力の最大
+        // (同じなら後ろ), 最良の山の高さ以上で最小 (同じなら前),
+        // 高さ未満で最大 (同じなら後ろ) を求める
+        // 労働力の昇順に安定ソートした列の上で use_card_greedy が選ぶ位置と一致する
+        alignas(64) int64_t su[LANES], da[LANES], d1[LANES];
+        alignas(64) int64_t wa_cap[LANES], wa_pos[LANES];
+        alignas(64) int64_t w1_cap[LANES], w1_pos[LANES];
+        alignas(64) int64_t w1_ge[LANES], w1_ge_pos[LANES];
+        alignas(64) int64_t w1_lt[LANES], w1_lt_pos[LANES];
+        for (int l = 0; l < LANES; ++l) {
+            su[l] = da[l] = d1[l] = -1;
+            wa_cap[l] = wa_pos[l] = -1;
+            w1_cap[l] = w1_pos[l] = -1;
+            w1_ge[l]              = INF;
+            w1_ge_pos[l]          = -1;
+            w1_lt[l] = w1_lt_pos[l] = -1;
+        }
+        for (int i = 0; i < hand_num(); ++i) {
+            for (int l = 0; l < LANES; ++l) {
+                const int64_t t = hand_type[i][l];
+                const int64_t a = hand_amount[i][l];
+                const bool w1   = t == WORK_ONE;
+                const bool first_su =
+                    (t == SCALE_UP) & (su[l] < 0) & (scale[l] < 20);
+                const bool first_da = (t == DELETE_ALL) & (da[l] < 0);
+                const bool first_d1 = (t == DELETE_ONE) & (d1[l] < 0);
+                const bool wa_max   = (t == WORK_ALL) & (a >= wa_cap[l]);
+                const bool w1_max   = w1 & (a >= w1_cap[l]);
+                const bool w1_min_ge =
+                    w1 & (a >= best_h[l]) & (a < w1_ge[l]);
+                const bool w1_max_lt = w1 & (a < best_h[l]) & (a >= w1_lt[l]);
+                su[l]                = first_su ? i : su[l];
+                da[l]                = first_da ? i : da[l];
+                d1[l]                = first_d1 ? i : d1[l];
+                wa_cap[l]            = wa_max ? a : wa_cap[l];
+                wa_pos[l]            = wa_max ? i : wa_pos[l];
+                w1_cap[l]            = w1_max ? a : w1_cap[l];
+                w1_pos[l]            = w1_max ? i : w1_pos[l];
+                w1_ge[l]             = w1_min_ge ? a : w1_ge[l];
+                w1_ge_pos[l]         = w1_min_ge ? i : w1_ge_pos[l];
+                w1_lt[l]             = w1_max_lt ? a : w1_lt[l];
+                w1_lt_pos[l]         = w1_max_lt ? i : w1_lt_pos[l];
+            }
+        }
+
+        alignas(64) int64_t work_all[LANES];
+        for (int l = 0; l < LANES; ++l) work_all[l] = 0;
+        for (int i = 0; i < mountain_num(); ++i) {
+            for (int l = 0; l < LANES; ++l) {
+                work_all[l] += min(wa_cap[l], height[i][l]);
+            }
+        }
+
+        for (int l = 0; l < LANES; ++l) {
+            // 働く場合の効率
+            const bool use_wa      = (wa_pos[l] >= 0) & (work_all[l] > 0);
+            const int64_t max_work = use_wa ? work_all[l] : 0;
+            const bool use_w1 =
+                (w1_pos[l] >= 0) & (min(w1_cap[l], best_h[l]) > max_work);
+            // 労働力が過剰なときは弱いカードを選ぶ
+            const bool over = (w1_ge[l] - best_h[l] > over_threshold[l])
+                              & (w1_lt_pos[l] >= 0);
+            int64_t w1_choice = over ? w1_lt_pos[l] : w1_ge_pos[l];
+            w1_choice         = w1_cap[l] < best_h[l] ? w1_pos[l] : w1_choice;
+            const bool use_d1 =
+                (d1[l] >= 0)
+                & (exact_double(worst_v[l])
+                   < exact_double(worst_h[l]) * DELETE_ONE_THRESHOLD_RATE);
+
+            // use_card_greedy と逆の優先順位で上書きする
+            int64_t c  = 0;
+            int64_t mt = hand_type[0][l] == DELETE_ONE ? worst[l] : 0;
+            c          = use_wa ? wa_pos[l] : c;
+            mt         = use_wa ? 0 : mt;
+            c          = use_w1 ? w1_choice : c;
+            mt         = use_w1 ? best[l] : mt;
+            c          = use_d1 ? d1[l] : c;
+            mt         = use_d1 ? worst[l] : mt;
+            c          = da[l] >= 0 ? da[l] : c;
+            mt         = da[l] >= 0 ? 0 : mt;
+            c          = su[l] >= 0 ? su[l] : c;
+            mt         = su[l] >= 0 ? 0 : mt;
+
+            use_pos[l]      = c;
+            mountain_pos[l] = mt;
+        }
+    }
+
+    /// @brief update_field のレーン版. 消えた山は erased に立てる
+    void update_field() {
+        alignas(64) int64_t type[LANES], amount[LANES];
+        for (int l = 0; l < LANES; ++l) type[l] = amount[l] = 0;
+        for (int i = 0; i < hand_num(); ++i) {
+            for (int l = 0; l < LANES; ++l) {
+                type[l]   = use_pos[l] == i ? hand_type[i][l] : type[l];
+                amount[l] = use_pos[l] == i ? hand_amount[i][l] : amount[l];
+            }
+        }
+        for (int i = 0; i < mountain_num(); ++i) {
+            for (int l = 0; l < LANES; ++l) {
+                const bool target = mountain_pos[l] == i;
+                const bool work =
+                    (type[l] == WORK_ALL) | ((type[l] == WORK_ONE) & target);
+                const bool del = (type[l] == DELETE_ALL)
+                                 | ((type[l] == DELETE_ONE) & target);
+                const int64_t h = height[i][l] - (work ? amount[l] : 0);
+                const bool done = work & (h <= 0);
+                money[l] += done ? value[i][l] : 0;
+                height[i][l] = h;
+                erased[i][l] = done | del;
+            }
+        }
+        for (int l = 0; l < LANES; ++l) {
+            scale[l] += type[l] == SCALE_UP;
+            over_threshold[l] = over_threshold_by_scale[scale[l]];
+        }
+    }
+
+    /// @brief 消えた山をシナリオの山で補充する
+    void refill(const Estimator* const scenarios[LANES], int pos) {
+        alignas(64) int64_t h[LANES], v[LANES];
+        for (int i = 0; i < mountain_num(); ++i) {
+            for (int l = 0; l < LANES; ++l) {
+                h[l] = scenarios[l]->future_mountains[pos][i].height;
+                v[l] = scenarios[l]->future_mountains[pos][i].value;
+            }
+            for (int l = 0; l < LANES; ++l) {
+                height[i][l] = erased[i][l] ? h[l] << scale[l] : height[i][l];
+                value[i][l]  = erased[i][l] ? v[l] << scale[l] : value[i][l];
+            }
+        }
+    }
+
+    /// @brief filter_next_cards と pick_card_greedy のレーン版
+    /// 選んだカードで use_pos の手札を置き換える
+    void pick_card_greedy(const Estimator* const scenarios[LANES], int pos,
+                          int turn) {
+        for (int j = 0; j < next_num(); ++j) {
+            for (int l = 0; l < LANES; ++l) {
+                const auto& card  = scenarios[l]->future_cards[pos].cards[j];
+                next_type[j][l]   = card.type;
+                next_amount[j][l] = card.work_amount;
+                next_cost[j][l]   = card.cost;
+            }
+            for (int l = 0; l < LANES; ++l) {
+                next_amount[j][l] <<= scale[l];
+                next_cost[j][l] <<= scale[l];
+            }
+        }
+
+        // ターンによる減衰率
+        // 閾値は非負なので, 整数に切り捨ててからコストと比べるのと
+        // double のまま比べるのは同じ
+        const double decay_rate = min(1.0, (T - turn) / 200.0);
+        // pick_card_greedy と同じく率を先に掛け合わせる
+        alignas(64) double scale_up_rate[LANES];
+        for (int l = 0; l < LANES; ++l) {
+            scale_up_rate[l] =
+                scale_up_rate_by_current_money[scale[l]] * decay_rate;
+        }
+        alignas(64) double work_thr[LANES], delete_one_thr[LANES],
+            scale_up_thr[LANES];
+        for (int l = 0; l < LANES; ++l) {
+            const double money_d = exact_double(money[l]);
+            work_thr[l]          = money_d * GREEDY_PICK_WORK_THRESHOLD;
+            delete_one_thr[l]    = money_d * GREEDY_PICK_DELETE_ONE_THRESHOLD;
+            scale_up_thr[l] =
+                min(money_d * scale_up_rate[l],
+                    exact_double(int64_t(1) << scale[l]) * 500.0);
+        }
+
+        // filter_next_cards: 買える WORK_ONE / WORK_ALL は労働力が
+        // 直前に残したものより大きいものだけを, 他の種類は先頭だけを残す
+        alignas(64) int64_t kept_w1[K_CAP][LANES], kept_wa[K_CAP][LANES];
+        alignas(64) int64_t w1_last[LANES], wa_last[LANES];
+        alignas(64) int64_t d1[LANES], su[LANES];
+        for (int l = 0; l < LANES; ++l) {
+            w1_last[l] = wa_last[l] = d1[l] = su[l] = -1;
+        }
+        for (int j = 0; j < next_num(); ++j) {
+            for (int l = 0; l < LANES; ++l) {
+                const int64_t t   = next_type[j][l];
+                const int64_t a   = next_amount[j][l];
+                const bool afford = next_cost[j][l] <= money[l];
+                const bool w1 = afford & (t == WORK_ONE) & (a > w1_last[l]);
+                const bool wa = afford & (t == WORK_ALL) & (a > wa_last[l]);
+                const bool first_d1 =
+                    afford & (t == DELETE_ONE) & (d1[l] < 0);
+                const bool first_su = afford & (t == SCALE_UP)
+                                      & (scale[l] < 20) & (su[l] < 0);
+                kept_w1[j][l] = w1;
+                kept_wa[j][l] = wa;
+                w1_last[l]    = w1 ? a : w1_last[l];
+                wa_last[l]    = wa ? a : wa_last[l];
+                d1[l]         = first_d1 ? j : d1[l];
+                su[l]         = first_su ? j : su[l];
+            }
+        }
+
+        // pick_card_greedy: 候補を WORK_ONE, WORK_ALL, DELETE_ONE の順に見て
+        // 利益が真に大きいものを選ぶ. 比較はすべて整数で行う (worth_work)
+        alignas(64) int64_t best_work[LANES];
+        alignas(64) int64_t best_pos[LANES];
+        for (int l = 0; l < LANES; ++l) {
+            best_work[l] = -INF;
+            best_pos[l]  = -1;
+        }
+        for (int j = 0; j < next_num(); ++j) {
+            for (int l = 0; l < LANES; ++l) {
+                const int64_t a    = next_amount[j][l];
+                const int64_t cost = next_cost[j][l];
+                const int64_t gain = a - cost;
+                const bool better  = kept_w1[j][l]
+                                    & (exact_double(cost) <= work_thr[l])
+                                    & worth_work(a, cost)
+                                    & (gain > best_work[l]);
+                best_work[l] = better ? gain : best_work[l];
+                best_pos[l]  = better ? j : best_pos[l];
+            }
+        }
+        for (int j = 0; j < next_num(); ++j) {
+            for (int l = 0; l < LANES; ++l) {
+                const int64_t a    = next_amount[j][l] * mountain_num();
+                const int64_t cost = next_cost[j][l];
+                const int64_t gain = a - cost;
+                const bool better  = kept_wa[j][l]
+                                    & (exact_double(cost) <= work_thr[l])
+                                    & worth_work(a, cost)
+                                    & (gain > best_work[l]);
+                best_work[l] = better ? gain : best_work[l];
+                best_pos[l]  = better ? j : best_pos[l];
+            }
+        }
+        alignas(64) int64_t d1_cost[LANES], su_cost[LANES];
+        for (int l = 0; l < LANES; ++l) d1_cost[l] = su_cost[l] = 0;
+        for (int j = 0; j < next_num(); ++j) {
+            for (int l = 0; l < LANES; ++l) {
+                d1_cost[l] = d1[l] == j ? next_cost[j][l] : d1_cost[l];
+                su_cost[l] = su[l] == j ? next_cost[j][l] : su_cost[l];
+            }
+        }
+        for (int l = 0; l < LANES; ++l) {
+            // 利益 2^scale / 2 - cost を 2 倍して比べる
+            const int64_t gain2 = (int64_t(1) << scale[l]) - 2 * d1_cost[l];
+            const bool affordable =
+                exact_double(d1_cost[l]) <= delete_one_thr[l];
+            const bool better = (d1[l] >= 0) & affordable
+                                & (gain2 > 2 * best_work[l]);
+            best_pos[l] = better ? d1[l] : best_pos[l];
+            // SCALE_UP があるときは SCALE_UP を選ぶ
+            const bool scale_up =
+                (su[l] >= 0) & (exact_double(su_cost[l]) <= scale_up_thr[l]);
+            best_pos[l] = scale_up ? su[l] : best_pos[l];
+        }
+
+        alignas(64) int64_t type[LANES], amount[LANES], cost[LANES];
+        for (int l = 0; l < LANES; ++l) type[l] = amount[l] = cost[l] = 0;
+        for (int j = 0; j < next_num(); ++j) {
+            for (int l = 0; l < LANES; ++l) {
+                const bool pick = best_pos[l] == j;
+                type[l]         = pick ? next_type[j][l] : type[l];
+                amount[l]       = pick ? next_amount[j][l] : amount[l];
+                cost[l]         = pick ? next_cost[j][l] : cost[l];
+            }
+        }
+        for (int l = 0; l < LANES; ++l) money[l] -= cost[l];
+        for (int i = 0; i < hand_num(); ++i) {
+            for (int l = 0; l < LANES; ++l) {
+                const bool replace = use_pos[l] == i;
+                hand_type[i][l]    = replace ? type[l] : hand_type[i][l];
+                hand_amount[i][l]  = replace ? amount[l] : hand_amount[i][l];
+            }
+        }
+    }
+
+    /// @brief scenarios[l] 上で Estimator::estimate と同じロールアウトを行い
+    /// 結果を out[l] に, mid_turn で打ち切ったときの評価値を mid_out[l] に書く
+    void estimate(const Estimator* const scenarios[LANES], int current_turn,
+                  int last_turn, int64_t current_money, int current_scale,
+                  const Hand& hand_, const Field& field_, double out[LANES],
+                  int mid_turn = -1, double* mid_out = nullptr) {
+#ifdef BENCH
+        bench::RolloutTimer timer(LANES, last_turn - current_turn);
+#endif
+        PROBE_SCOPE("batch_estimate");
+        rollout_counter.add(LANES);
+        n = hand_.n;
+        m = field_.m;
+        k = input::next_cards.k;
+        assert((!N || n == N) && (!M || m == M) && (!K || k == K));
+        for (int i = 0; i < hand_num(); ++i) {
+            for (int l = 0; l < LANES; ++l) {
+                hand_type[i][l]   = hand_.cards[i].type;
+                hand_amount[i][l] = hand_.cards[i].work_amount;
+            }
+        }
+        for (int i = 0; i < mountain_num(); ++i) {
+            for (int l = 0; l < LANES; ++l) {
+                height[i][l] = field_.mountains[i].height;
+                value[i][l]  = field_.mountains[i].value;
+            }
+        }
+        for (int l = 0; l < LANES; ++l) {
+            money[l]          = current_money;
+            scale[l]          = current_scale;
+            over_threshold[l] = over_threshold_by_scale[current_scale];
+        }
+
+        for (int turn = current_turn; turn < last_turn; ++turn) {
+            use_card_greedy();
+            update_field();
+            if (turn + 1 == mid_turn) {
+                for (int l = 0; l < LANES; ++l) {
+                    mid_out[l] =
+                        money[l] + C1 * (T - mid_turn) * (1 << scale[l]);
+                }
+            }
+            if (turn < T - 1) {
+                const int pos = turn & (SCENARIO_RING_SIZE - 1);
+                refill(scenarios, pos);
+                pick_card_greedy(scenarios, pos, turn);
+            }
+        }
+        for (int l = 0; l < LANES; ++l) {
+            out[l] = money[l] + C1 * (T - last_turn) * (1 << scale[l]);
+        }
+    }
+};
+
+/// @brief (N, M, K) ごとに特殊化したロールアウトの関数表
+/// 試合中 N, M, K は変わらないので io::input_first の直後に 1 度だけ選ぶ
+namespace rollout_kernel {
+    /// @brief 特殊化する次元
+    /// 3 つとも特殊化すると 168 通りになりコンパイルに 3 分以上かかるので,
+    /// ループの大半を占める山の数だけを特殊化する
+    /// (N, K を足しても 1 ターンあたり 1 割未満しか速くならない)
+    constexpr bool SPECIALIZE_N = false;
+    constexpr bool SPECIALIZE_M = true;
+    constexpr bool SPECIALIZE_K = false;
+
+    using Estimate = double (*)(Estimator& scenario, int current_turn,
+                                int last_turn, int64_t current_money,
+                                int current_scale, const Hand& hand,
+                                const Field& field, int mid_turn,
+                                double* mid_out);
+    using BatchEstimate = void (*)(const Estimator* const scenarios[],
+                                   int current_turn, int last_turn,
+                                   int64_t current_money, int current_scale,
+                                   const Hand& hand, const Field& field,
+                                   double out[], int mid_turn,
+                                   double* mid_out);
+
+    struct Kernel {
+        Estimate estimate;
+        BatchEstimate batch_estimate;
+    };
+
+    /// @tparam N, M, K 0 なら実行時の値を使う
+    template <int N, int M, int K>
+    double estimate(Estimator& scenario, int current_turn, int last_turn,
+                    int64_t current_money, int current_scale, const Hand& hand,
+                    const Field& field, int mid_turn, double* mid_out) {
+        return scenario.estimate<M, K>(current_turn, last_turn, current_money,
+                                       current_scale, hand, field, mid_turn,
+                                       mid_out);
+    }
+
+    template <int N, int M, int K>
+    void batch_estimate(const Estimator* const scenarios[], int current_turn,
+                        int last_turn, int64_t current_money,
+                        int current_scale, const Hand& hand,
+                        const Field& field, double out[], int mid_turn,
+                        double* mid_out) {
+        BatchEstimator<N, M, K> batch;
+        batch.estimate(scenarios, current_turn, last_turn, current_money,
+                       current_scale, hand, field, out, mid_turn, mid_out);
+    }
+
+    constexpr int N_NUM = N_UB - N_LB + 1;
+    constexpr int M_NUM = M_UB - M_LB + 1;
+    constexpr int K_NUM = K_UB - K_LB + 1;
+
+    constexpr int index(int n, int m, int k) {
+        return ((n - N_LB) * M_NUM + (m - M_LB)) * K_NUM + (k - K_LB);
+    }
+
+    template <int I>
+    constexpr Kernel make_kernel() {
+        constexpr int N = N_LB + I / (M_NUM * K_NUM);
+        constexpr int M = M_LB + I / K_NUM % M_NUM;
+        constexpr int K = K_LB + I % K_NUM;
+        static_assert(index(N, M, K) == I);
+        constexpr int SN = SPECIALIZE_N ? N : 0;
+        constexpr int SM = SPECIALIZE_M ? M : 0;
+        constexpr int SK = SPECIALIZE_K ? K : 0;
+        return {&estimate<SN, SM, SK>, &batch_estimate<SN, SM, SK>};
+    }
+
+    template <size_t... I>
+    constexpr array<Kernel, sizeof...(I)> make_table(index_sequence<I...>) {
+        return {make_kernel<I>()...};
+    }
+
+    constexpr auto table =
+        make_table(make_index_sequence<N_NUM * M_NUM * K_NUM>());
+
+    /// @brief select で選んだ現在の試合用のカーネル
+    GAME_LOCAL Kernel current;
+
+    void select(int n, int m, int k) {
+        assert(N_LB <= n && n <= N_UB);
+        assert(M_LB <= m && m <= M_UB);
+        assert(K_LB <= k && k <= K_UB);
+        current = table[index(n, m, k)];
+    }
+} // namespace rollout_kernel
+
+/// @brief ターンをまたいで使い回すシナリオの集合
+/// 毎ターン期限切れのターンを捨てて末尾だけを生成し,
+/// freq から推定した重みが大きく動いたときだけ作り直す
+struct ScenarioPool {
+    vector<Estimator> scenarios;
+    double w[5]         = {};
+    bool weights_ready  = false;
+    int64_t refresh_num = 0;
+    // 直前の prepare の範囲と, その範囲まで揃えたシナリオの数
+    int first_turn_ = 0;
+    int last_turn_  = 0;
+    int prepared    = 0;
+
+    void prepare(int sample_num, int first_turn, int last_turn,
+                 const int64_t freq[5]) {
+        PROBE_SCOPE("scenario_prepare");
+        double nw[5];
+        normalized_weights(freq, nw);
+        double diff = 0;
+        for (int i = 0; i < 5; ++i) {
+            diff = max(diff, abs(nw[i] - w[i]));
+        }
+        if (!weights_ready || diff > SCENARIO_REFRESH_THRESHOLD) {
+            weights_ready = true;
+            refresh_num++;
+            copy(nw, nw + 5, w);
+            for (auto& s : scenarios) {
+                s.input_generator.set_weights(w);
+                s.clear();
+            }
+        }
+        first_turn_ = first_turn;
+        last_turn_  = last_turn;
+        prepared    = 0;
+        extend(sample_num);
+    }
+
+    /// @brief 先頭 n 個のシナリオを直前の prepare の範囲まで揃える
+    /// 探索が prepare した数より多くのシナリオを使うときに, 使う分だけ足す
+    void extend(int n) {
+        if (n <= prepared) return;
+        while ((int)scenarios.size() < n) {
+            scenarios.emplace_back();
+            scenarios.back().input_generator.set_weights(w);
+        }
+        for (; prepared < n; ++prepared) {
+            scenarios[prepared].advance(first_turn_, last_turn_);
+        }
+    }
+
+    inline Estimator& operator[](int i) { return scenarios[i]; }
+};
+
+GAME_LOCAL ScenarioPool scenario_pool;
+
+#ifdef PARALLEL_ROLLOUT
+/// @brief pick_card の探索フェーズで, 1 度にワーカー 1 つあたり何回の
+/// 試行を配るか. ロールアウト 1 回は数 us なので, 1 回ずつでは同期が主になる
+constexpr int PULLS_PER_WORKER = 4;
+
+/// @brief ロールアウトに使うスレッド数 (呼び出し元スレッドを含む)
+/// LOCAL では環境変数 ROLLOUT_THREADS で変えられる
+/// (make bench-parallel でスレッド数ごとの速さを比べる)
+int rollout_threads() {
+#ifdef LOCAL
+    if (const char* s = getenv("ROLLOUT_THREADS")) return max(1, atoi(s));
+#endif
+    return thread_pool::hardware_threads();
+}
+
+// ワーカーごとに独立した xorshift のストリームを割り当てる
+thread_pool::ThreadPool& rollout_pool() {
+    static thread_pool::ThreadPool pool(rollout_threads(), [](int worker_id) {
+        xorshift::set_stream(xorshift::DEFAULT_SEED, worker_id);
+    });
+    return pool;
+}
+#endif
+
+GAME_LOCAL int64_t total_us_pick_card = 0;
+GAME_LOCAL int64_t pick_card_call_num = 0;
+GAME_LOCAL double avg_ms_pick_card    = 1;
+
+/// @brief 試合全体の持ち時間. 各ターンへの配分はここから切り出す
+GAME_LOCAL scheduler::TurnBudget turn_budget(TIME_LIMIT_MS - TIME_MARGIN_MS);
+/// @brief pick_card の初期化フェーズのロールアウトにかかった時間 (候補
+/// 1 つあたり, マイクロ秒) の移動平均. シナリオの生成は含めない
+/// これより配分が少ないターンは貪欲に選ぶ
+GAME_LOCAL double initial_us_per_candidate = 0;
+
+/// @brief 補充候補の選択に配る時間の重み
+/// 比べる候補が多いほど, また序盤・終盤ほど重くする
+inline double decision_weight(int turn, int candidate_num) {
+    const double weight = max(0, candidate_num - 1);
+    return turn <= SETUP_TURN || turn >= T - TEARDOWN_TURN
+               ? weight * SETUP_TEARDOWN_TIME_WEIGHT
+               : weight;
+}
+
+/// @brief turn より後に補充候補を選ぶターンの重みの合計の見込み
+/// @param mean_weight これまでのターンの (序盤・終盤の倍率を除いた) 重みの平均
+double rest_decision_weight(int turn, double mean_weight) {
+    const int last     = T - 2; // 最後のターンは選ばない
+    const int rest     = max(0, last - turn);
+    const int setup    = max(0, min(SETUP_TURN, last) - turn);
+    const int teardown = max(0, last - max(turn + 1, T - TEARDOWN_TURN) + 1);
+    const int special  = setup + teardown;
+    return mean_weight
+           * (rest - special + special * SETUP_TEARDOWN_TIME_WEIGHT);
+}
+
+/// @brief ロールアウトのターン数を, 似た状況での過去の決定から伸び縮みさせる
+/// 決定を終えるたびに, ロールアウトの途中 (HORIZON_MID_RATIO の位置) と
+/// 最後の評価値とで最良の候補が変わったかを見て, 変わったならターン数が
+/// 決定を左右しているので伸ばし, 変わらないなら縮めて浮いた時間を
+/// サンプル数に回す. 伸び縮みは次からの同じ文脈の決定に効く
+/// 文脈は試合の区間 (残りターン数), scale, SCALE_UP が候補にあるかで分ける
+struct RolloutHorizon {
+    constexpr static int CONTEXTS = HORIZON_PHASES * 2 * 2;
+    double turns_[CONTEXTS] = {};
+    /// 初期値. 伸び縮みはこの HORIZON_MIN_RATIO 倍から HORIZON_MAX_RATIO
+    /// 倍の範囲に留める (途中と最後の比較では範囲外の短視眼は見えない)
+    double base = 0;
+
+    static int context(int turn, int scale, bool scale_up) {
+        const int phase = min(HORIZON_PHASES - 1, turn * HORIZON_PHASES / T);
+        return (phase * 2 + (scale >= HORIZON_SCALE_SPLIT)) * 2 + scale_up;
+    }
+
+    static int context(const NextCards& nc, const CardPositions& candidates,
+                       int turn, int scale) {
+        bool scale_up = false;
+        for (int pos : candidates) scale_up |= nc.cards[pos].type == SCALE_UP;
+        return context(turn, scale, scale_up);
+    }
+
+    /// @brief ターン数の上限
+    /// シナリオは SCENARIO_RING_SIZE ターンまでしか持てず, search_use_card
+    /// は pick_card より 1 ターン手前から turns + 1 ターン分を使う
+    constexpr static int MAX_TURNS = SCENARIO_RING_SIZE - 1;
+
+    int turns(int context) {
+        if (turns_[context] == 0) {
+            base            = min<double>(input::next_cards.k <= 2
+                                              ? SIMULATION_TURNS_WHEN_FEW_CARDS
+                                              : SIMULATION_TURNS,
+                                          MAX_TURNS);
+            turns_[context] = base;
+        }
+        return turns_[context];
+    }
+
+    /// @param changed 途中と最後で最良の候補が変わったか
+    void update(int context, bool changed) {
+        if (!ADAPTIVE_HORIZON) return;
+        turns_[context] = clamp(
+            turns_[context]
+                * (changed ? HORIZON_GROW_RATE : HORIZON_SHRINK_RATE),
+            base * HORIZON_MIN_RATIO,
+            min(base * HORIZON_MAX_RATIO, (double)MAX_TURNS));
+    }
+};
+
+GAME_LOCAL RolloutHorizon rollout_horizon;
+
+/// @brief turn に補充するカードを選ぶときのロールアウトの
+/// (最後のターン, 途中の評価値を記録するターン)
+/// 途中のターンは, 短すぎるときは記録しないので -1
+pair<int, int> rollout_span(int turn, int turns) {
     const int last_turn = min(turn + turns, T);
-    static vector<Estimator> estimators;
-    estimators.clear();
-    const int sample_num = avg_ms_pick_card < SIMULATION_MS_THRESHOLD
-                               ? SIMULATION_SAMPLES_WHEN_FAST_CASE
-                               : SIMULATION_SAMPLES_WHEN_SLOW_CASE;
-    for (int i = 0; i < sample_num; ++i) {
-        estimators.emplace_back(turn, last_turn, freq[0], freq[1], freq[2],
-                                freq[3], freq[4]);
+    const int span      = last_turn - turn - 1;
+    const int mid_turn =
+        span >= 2 ? turn + 1 + max(1, (int)(span * HORIZON_MID_RATIO)) : -1;
+    return {last_turn, mid_turn};
+}
+
+/// @brief pick_card と search_use_card で使うシナリオの数
+/// (1 候補あたりのロールアウトの上限)
+inline int pick_card_sample_num() {
+    return avg_ms_pick_card < SIMULATION_MS_THRESHOLD
+               ? SIMULATION_SAMPLES_WHEN_FAST_CASE
+               : SIMULATION_SAMPLES_WHEN_SLOW_CASE;
+}
+
+/// @brief 探索フェーズのロールアウト 1 本の 1 ターンあたりの実時間
+/// (マイクロ秒) の移動平均. 0 なら未計測
+GAME_LOCAL double us_per_rollout_turn = 0;
+
+/// @brief 探索フェーズで pulls 本のロールアウト (各 turns ターン) に
+/// us マイクロ秒かかったことを us_per_rollout_turn に反映する
+inline void record_rollout_cost(int64_t us, int pulls, int turns) {
+    if (pulls <= 0 || turns <= 0) return;
+    const double per = (double)us / pulls / turns;
+    us_per_rollout_turn =
+        us_per_rollout_turn == 0 ? per : 0.9 * us_per_rollout_turn + 0.1 * per;
+}
+
+/// @brief 探索フェーズで 1 候補あたりに使うシナリオの数の上限
+/// pick_card_sample_num() に加えて, 各候補を first_tries 本ずつ試した
+/// 後の残り時間 rest_us で回せる分 (rest_us / (候補の数 × ロールアウト
+/// 1 本の時間)) まで増やす. 候補が少ない, ロールアウトが短いなどで
+/// 上限が先に来て時間が余るのを防ぐ
+/// 増やした分のシナリオは探索がそこまで進んだときに extend で作る
+inline int search_sample_num(int64_t rest_us, int arms, int turns,
+                             int first_tries) {
+    const int base = pick_card_sample_num();
+    if (us_per_rollout_turn == 0) return base;
+    const double affordable =
+        first_tries + rest_us / (us_per_rollout_turn * max(turns, 1) * arms);
+    return max<double>(base, min<double>(affordable, SIMULATION_SAMPLES_MAX));
+}
+
+/// @brief 初期化フェーズで各候補を first_tries 回ずつ試したあとに,
+/// bandit に配る試行回数 (pick_card と search_use_card で共通)
+inline int search_tries(int sample_num, int first_tries, int arms) {
+    return max(0, sample_num - first_tries) * arms;
+}
+
+/// @brief pick_card の初期化フェーズで各候補に回すブロック (BATCH_LANES 個の
+/// ロールアウト) の数
+constexpr int FIRST_BLOCKS = (EACH_FIRST_TRIES + BATCH_LANES - 1) / BATCH_LANES;
+
+#ifdef SPECULATIVE_SEARCH
+/// @brief 入力を待つ間に, 次の pick_card の仕事を裏のスレッドで先に済ませる
+///
+/// 補充候補の 0 枚目は常にコスト 0 の WORK_ONE (労働力 2^scale) で,
+/// 使ったカードで山が消えなければ次の山も分かっている. そのときは
+/// この候補の初期化フェーズのロールアウトを入力を待たずに行える
+/// 入力が来たら裏の仕事を打ち切り (cancel), 入力までに終わっていて
+/// 前提 (山・所持金・ロールアウトの長さ・シナリオ) が当たっていれば
+/// pick_card で使う. 入力の後は裏の仕事を長く走らせない
+struct Speculation {
+    thread_pool::BackgroundWorker worker;
+    bool valid = false;
+    /// 裏の仕事はブロックの切れ目でこれを見て打ち切る
+    atomic<bool> cancelled = false;
+    // 前提
+    int turn;
+    int used_pos;
+    Card card;
+    Hand hand;
+    Field field;
+    int64_t money;
+    int scale;
+    int last_turn;
+    int mid_turn;
+    int64_t refresh_num;
+    /// 先に済ませたロールアウトを pick_card で使えた回数
+    int64_t reused_num = 0;
+    // 結果. 並びは pick_card の first_scores の 1 候補分と同じ
+    double scores[FIRST_BLOCKS * BATCH_LANES];
+    double mid_scores[FIRST_BLOCKS * BATCH_LANES];
+
+    Speculation()
+        : worker([] {
+              // ロールアウトのワーカー (0, 1, ...) と重ならない番号にする
+#ifdef PARALLEL_ROLLOUT
+              xorshift::set_stream(xorshift::DEFAULT_SEED, rollout_threads());
+#else
+              xorshift::set_stream(xorshift::DEFAULT_SEED,
+                                   thread_pool::hardware_threads());
+#endif
+          }) {}
+
+    /// @brief 山・手札は使ったカードを反映した後のもの. 入力を読む前に呼ぶ
+    void start(const Hand& h, int used_pos_, const Field& f,
+               int64_t current_money, int current_scale, int turn_,
+               const int64_t freq_[5]) {
+        worker.wait();
+        valid     = false;
+        cancelled = false;
+        if (turn_ >= T - 1) return;
+        int64_t freq[5];
+        copy(freq_, freq_ + 5, freq);
+        const bool known_field = f.live == f.all_mask();
+        turn                   = turn_;
+        used_pos               = used_pos_;
+        card        = {0, WORK_ONE, 1ll << current_scale, 0};
+        hand        = h;
+        field       = f;
+        money       = current_money;
+        scale       = current_scale;
+        tie(last_turn, mid_turn) =
+            rollout_span(turn, rollout_horizon.turns(RolloutHorizon::context(
+                                   turn, current_scale, false)));
+        worker.submit([this, freq, known_field] {
+            if (cancelled) return;
+            const int sample_num = pick_card_sample_num();
+            scenario_pool.prepare(sample_num, turn + 1, last_turn, freq);
+            refresh_num = scenario_pool.refresh_num;
+            if (!known_field) return;
+            hand.cards[used_pos] = card;
+            // mid_turn まで進まないレーンは書かれないので, pick_card と同じく
+            // 0 にしておく
+            fill(begin(mid_scores), end(mid_scores), 0.0);
+            for (int bg = 0; bg < FIRST_BLOCKS * BATCH_LANES;
+                 bg += BATCH_LANES) {
+                if (cancelled) return;
+                const Estimator* scenarios[BATCH_LANES];
+                for (int l = 0; l < BATCH_LANES; ++l) {
+                    scenarios[l] = &scenario_pool[min(bg + l,
+                                                      EACH_FIRST_TRIES - 1)];
+                }
+                rollout_kernel::current.batch_estimate(
+                    scenarios, turn + 1, last_turn, money, scale, hand, field,
+                    scores + bg, mid_turn, mid_scores + bg);
+            }
+            valid = true;
+        });
+    }
+
+    /// @brief 入力が来たら呼ぶ. 裏の仕事を次のブロックの切れ目で止め,
+    /// 終わっていなかったなら結果は使わない. 止まるのは待たない
+    void cancel() { cancelled = true; }
+
+    /// @brief 裏の仕事が止まるのを待つ. シナリオを触る前に呼ぶ
+    /// cancel の後なら待つのは高々ブロック 1 つ分 (かシナリオの準備) になる
+    void wait() { worker.wait(); }
+
+    /// @brief 前提が当たっていれば, 先に済ませたロールアウトを持つ候補の番号
+    int reusable_arm(const NextCards& nc, const CardPositions& candidates,
+                     const Field& f, int turn_, int last_turn_,
+                     int mid_turn_) const {
+        if (!valid || turn_ != turn || last_turn_ != last_turn
+            || mid_turn_ != mid_turn
+            || scenario_pool.refresh_num != refresh_num) {
+            return -1;
+        }
+        for (int i = 0; i < f.m; ++i) {
+            if (f.mountains[i].height != field.mountains[i].height
+                || f.mountains[i].value != field.mountains[i].value) {
+                return -1;
+            }
+        }
+        for (int arm = 0; arm < (int)candidates.size(); ++arm) {
+            const auto& c = nc.cards[candidates[arm]];
+            if (c.type == card.type && c.work_amount == card.work_amount
+                && c.cost == card.cost) {
+                return arm;
+            }
+        }
+        return -1;
+    }
+
+    /// @brief reusable_arm の結果を使ったことを数える
+    void count_reuse(int arm) {
+        if (arm >= 0) reused_num++;
     }
+};
+
+Speculation& speculation() {
+    static Speculation s;
+    return s;
+}
+#endif
+
+/// @brief モンテカルロで補充するカードを選ぶ
+/// @param candidates filter_next_cards で絞った候補 (2 つ以上)
+/// @param deadline このターンの期限
+int pick_card(const Hand& h_, int used_pos, const Field& f, const NextCards& nc,
+              const CardPositions& candidates, int64_t current_money,
+              int current_scale, int turn, int64_t freq[5],
+              const scheduler::Deadline& deadline) {
+    PROBE_SCOPE("pick_card");
+    assert(candidates.size() >= 2u);
+    const int horizon_context =
+        RolloutHorizon::context(nc, candidates, turn, current_scale);
+    const int turns           = rollout_horizon.turns(horizon_context);
+    const auto [last_turn, mid_turn] = rollout_span(turn, turns);
+    const int sample_num             = pick_card_sample_num();
+    scenario_pool.prepare(sample_num, turn + 1, last_turn, freq);
 
     Hand h;
     h.n = h_.n;
@@ -697,68 +1785,411 @@ int pick_card(const Hand& h_, int used_pos, const Field& f, const NextCards& nc,
         h.cards[i].work_amount = h_.cards[i].work_amount;
     }
 
-    UpperConfidenceBound ucb(candidates.size());
-    // initialize
-    for (size_t i = 0; i < candidates.size(); ++i) {
-        const int nc_pos  = candidates[i];
-        h.cards[used_pos] = nc.cards[nc_pos];
-
-        for (int j = 0; j < EACH_FIRST_TRIES; j++) {
-            const double score = estimators[j].estimate(
-                turn + 1, last_turn, current_money - nc.cards[nc_pos].cost,
-                current_scale, h, f);
-            ucb.update(i, score);
-        }
-    }
-
-    const int tries = (sample_num - EACH_FIRST_TRIES) * candidates.size();
-    // const double c         = (1 << current_scale) * T * UCB_C;
-    double total       = 0;
-    const double ucb_c = input::next_cards.k <= 2 ? 0.7 : 1.0;
-    for (int i = 0; i < tries; ++i) {
-        const double c    = (total / ucb.total_count) * ucb_c;
-        const int arm     = ucb.select_arm(c);
-        const int nc_pos  = candidates[arm];
-        h.cards[used_pos] = nc.cards[nc_pos];
-        const int round   = ucb.count(arm);
-        if (round >= (int)estimators.size()) {
-            // estimators.emplace_back(turn, last_turn, freq[0], freq[1],
-            // freq[2],
-            //                         freq[3], freq[4]);
+    // arm 番目の候補を取ったときのロールアウトを round 番目のシナリオで行う
+    // mid_turn での評価値を *mid_out に書く
+    auto rollout = [&](int arm, int round, double* mid_out) {
+        Hand hh            = h;
+        const int nc_pos   = candidates[arm];
+        hh.cards[used_pos] = nc.cards[nc_pos];
+        *mid_out           = 0;
+        return rollout_kernel::current.estimate(
+            scenario_pool[round], turn + 1, last_turn,
+            current_money - nc.cards[nc_pos].cost, current_scale, hh, f,
+            mid_turn, mid_out);
+    };
+
+    BestArmIdentification bandit(
+        candidates.size(), (BanditStrategy)BANDIT_STRATEGY, EACH_FIRST_TRIES);
+    const auto& ucb = bandit.ucb;
+    // mid_turn で打ち切ったときの評価値の統計
+    FixedVector<UcbArmMetrics, K_UB> mid_metrics;
+    for (int i = 0; i < (int)candidates.size(); ++i) mid_metrics.emplace_back();
+#ifdef PARALLEL_ROLLOUT
+    auto& pool = rollout_pool();
+    static vector<pair<int, int>> tasks; // (arm, round)
+    static vector<double> scores, mid_scores;
+    // 結果はタスクごとの領域に書き, 全タスク終了後にまとめて UCB へ反映する
+    auto run_tasks = [&] {
+        scores.resize(tasks.size());
+        mid_scores.resize(tasks.size());
+        pool.parallel_for(
+            tasks.size(),
+            [&](int task_id, int) {
+                scores[task_id] = rollout(tasks[task_id].first,
+                                          tasks[task_id].second,
+                                          &mid_scores[task_id]);
+            },
+            PULLS_PER_WORKER);
+        for (size_t t = 0; t < tasks.size(); ++t) {
+            bandit.update(tasks[t].first, scores[t]);
+            mid_metrics[tasks[t].first].update(mid_scores[t]);
+        }
+    };
+#endif
+
+    // initialize: 各候補を先頭 EACH_FIRST_TRIES 個のシナリオで
+    // BATCH_LANES 個ずつまとめて評価する
+    // タスクはブロック順に並べ, 時間切れのときは揃った列までを使う
+    constexpr int LANES  = BATCH_LANES;
+    constexpr int BLOCKS = FIRST_BLOCKS;
+    const int arms       = candidates.size();
+#ifdef SPECULATIVE_SEARCH
+    // 入力待ちの間に済ませたロールアウトがあれば使う
+    const int reused_arm = speculation().reusable_arm(
+        nc, candidates, f, turn, last_turn, mid_turn);
+    speculation().count_reuse(reused_arm);
+#else
+    constexpr int reused_arm = -1;
+#endif
+    static GAME_LOCAL vector<double> first_scores, first_mid_scores;
+    first_scores.resize(arms * BLOCKS * LANES);
+    first_mid_scores.assign(arms * BLOCKS * LANES, 0);
+    auto rollout_block = [&](int task_id) {
+        const int arm = task_id % arms;
+        const int bg  = task_id / arms * LANES;
+        const Estimator* scenarios[LANES];
+        for (int l = 0; l < LANES; ++l) {
+            // 余ったレーンは結果を捨てる
+            scenarios[l] = &scenario_pool[min(bg + l, EACH_FIRST_TRIES - 1)];
+        }
+        Hand hh            = h;
+        const int nc_pos   = candidates[arm];
+        hh.cards[used_pos] = nc.cards[nc_pos];
+        double* out     = &first_scores[(arm * BLOCKS * LANES) + bg];
+        double* mid_out = &first_mid_scores[(arm * BLOCKS * LANES) + bg];
+        if (arm == reused_arm) {
+#ifdef SPECULATIVE_SEARCH
+            copy_n(speculation().scores + bg, LANES, out);
+            copy_n(speculation().mid_scores + bg, LANES, mid_out);
+#endif
+        }
+        else {
+            rollout_kernel::current.batch_estimate(
+                scenarios, turn + 1, last_turn,
+                current_money - nc.cards[nc_pos].cost, current_scale, hh, f,
+                out, mid_turn, mid_out);
+        }
+#ifndef NDEBUG
+        for (int l = 0; l < LANES && bg + l < EACH_FIRST_TRIES; ++l) {
+            double mid;
+            assert(out[l] == rollout(arm, bg + l, &mid));
+            assert(mid_out[l] == mid);
+        }
+#endif
+    };
+    int blocks = BLOCKS; // 全候補について評価し終えたブロック数
+    // シナリオの生成は含めずに時間を測る (search_use_card と同じ)
+    const int64_t initial_begin_us = deadline.elapsed_us();
+#ifdef PARALLEL_ROLLOUT
+    // 全スレッドが埋まるだけのブロックの列ずつ流し, 列の間で期限を見る
+    const int wave = (pool.size() + arms - 1) / arms;
+    for (int bg = 0; bg < BLOCKS; bg += wave) {
+        const int ed = min(BLOCKS, bg + wave);
+        pool.parallel_for((ed - bg) * arms, [&](int task_id, int) {
+            rollout_block(bg * arms + task_id);
+        });
+        if (deadline.expired()) {
+            blocks = ed;
             break;
         }
-        auto& estimator    = estimators[round];
-        const double score = estimator.estimate(
-            turn + 1, last_turn, current_money - nc.cards[nc_pos].cost,
-            current_scale, h, f);
-        total += score;
-        ucb.update(arm, score);
-        if (ucb.check_early_stop(c)) {
-            // cout << "# early stop" << i << "/" << tries << "\n";
+    }
+#else
+    for (int task_id = 0; task_id < arms * BLOCKS; ++task_id) {
+        rollout_block(task_id);
+        if ((task_id + 1) % arms == 0 && deadline.expired()) {
+            blocks = (task_id + 1) / arms;
             break;
         }
     }
+#endif
+    const int first_tries = min(EACH_FIRST_TRIES, blocks * LANES);
+    for (int i = 0; i < arms; ++i) {
+        for (int j = 0; j < first_tries; j++) {
+            bandit.update(i, first_scores[i * BLOCKS * LANES + j]);
+            mid_metrics[i].update(first_mid_scores[i * BLOCKS * LANES + j]);
+        }
+    }
+    // 先に済ませた候補はロールアウトしていないので数えない
+    const int rolled_arms = arms - (reused_arm >= 0);
+    const double initial_us_per_arm =
+        (double)(deadline.elapsed_us() - initial_begin_us) * BLOCKS / blocks
+        / rolled_arms;
+    initial_us_per_candidate = initial_us_per_candidate == 0
+                                   ? initial_us_per_arm
+                                   : 0.9 * initial_us_per_candidate
+                                         + 0.1 * initial_us_per_arm;
+
+    // 初期化の時点で差がはっきりしている決定ほど残りの探索を短くし,
+    // 浮いた時間は以後のターンに回す
+    const double gap  = max(0.0, ucb.paired_gap_z() - 1);
+    auto ucb_deadline = deadline.sub_us(deadline.rest_us() / (1 + gap),
+                                        SEARCH_MAX_CHECK_INTERVAL);
+
+    // 期限で初期化を打ち切ったときは first_tries < EACH_FIRST_TRIES
+    const int sample_cap = search_sample_num(
+        ucb_deadline.rest_us(), arms, last_turn - turn - 1, first_tries);
+    const int tries = search_tries(sample_cap, first_tries, arms);
+    bandit.start(tries, sample_cap);
+    const int64_t search_begin_us = deadline.elapsed_us();
+    const int search_begin_count  = ucb.total_count;
+    const double search_begin_sum = ucb.reward_sum();
+    const double ucb_c =
+        input::next_cards.k <= 2 ? UCB_C_WHEN_FEW_CARDS : UCB_C;
+    for (int i = 0; i < tries;) {
+        PROBE_SCOPE("pick_card_iteration");
+        if (!ucb_deadline.alive()) {
+            break;
+        }
+        const double c =
+            (ucb.reward_sum() - search_begin_sum) / ucb.total_count * ucb_c;
+#ifdef PARALLEL_ROLLOUT
+        // ワーカー 1 つに PULLS_PER_WORKER 回ずつ配る. 選んだ試行は
+        // 結果待ちとして数えるので, 続けて選ぶと同じ arm の探索項が縮み,
+        // 別の arm にも配られる
+        const int slots = min(pool.size() * PULLS_PER_WORKER, tries - i);
+        int rounds      = 0;
+        tasks.clear();
+        while ((int)tasks.size() < slots) {
+            const int arm =
+                bandit.select_arm(c, [] { return xorshift::getNormal(); });
+            if (arm < 0) {
+                break;
+            }
+            tasks.emplace_back(arm, bandit.issue(arm));
+            rounds = max(rounds, tasks.back().second + 1);
+        }
+        if (tasks.empty()) {
+            break;
+        }
+        scenario_pool.extend(rounds);
+        run_tasks();
+        i += tasks.size();
+#else
+        const int arm =
+            bandit.select_arm(c, [] { return xorshift::getNormal(); });
+        if (arm < 0) {
+            break;
+        }
+        const int round = ucb.count(arm);
+        scenario_pool.extend(round + 1);
+        double mid;
+        bandit.update(arm, rollout(arm, round, &mid));
+        mid_metrics[arm].update(mid);
+        i++;
+#endif
+        // 同じ round の報酬は同じシナリオ上のものなので対応のある差で比べる
+        if (bandit.check_early_stop()) {
+            PROBE_COUNT("pick_card_early_stop");
+            break;
+        }
+    }
+    record_rollout_cost(deadline.elapsed_us() - search_begin_us,
+                        ucb.total_count - search_begin_count,
+                        last_turn - turn - 1);
 
-
-    // cout << "# (turn, money, scale, best_score) = (" << turn << ", "
-    //      << current_money << ", " << current_scale << ", "
-    //      << ucb.average(ucb.best_arm()) << ")"
-    //      << "\n";
-    // cout << "# ";
-    // for (int i = 0; i < (int)candidates.size(); ++i) {
-    //     cout << ucb.average(i) << " ";
-    // }
-    // cout << "\n# ";
-    // for (int i = 0; i < (int)candidates.size(); ++i) {
-    //     cout << ucb.count(i) << " ";
-    // }
-    // cout << "->" << ucb.best_arm();
-    // cout << endl;
-    total_ms_pick_card +=
-        duration_cast<milliseconds>(high_resolution_clock::now() - now).count();
+    total_us_pick_card += deadline.elapsed_us();
     pick_card_call_num++;
+    avg_ms_pick_card =
+        max(1.0, total_us_pick_card / 1e3 / pick_card_call_num);
+
+    const int best = bandit.best_arm();
+    // 途中で打ち切ったときの最良の候補が, 最後まで見ると有意に悪いなら
+    // ターン数が決定を変えているので伸ばす. そうでなければ縮めてよい
+    // 試合の終わりで打ち切られたターン数は判断に使わない
+    if (mid_turn >= 0 && turn + turns < T) {
+        int mid_best = 0;
+        for (int i = 1; i < arms; ++i) {
+            if (mid_metrics[i].average() > mid_metrics[mid_best].average()) {
+                mid_best = i;
+            }
+        }
+        const auto& diff = ucb.diff(best, mid_best);
+        const bool changed =
+            mid_best != best && diff.count >= 2
+            && diff.average() > HORIZON_SIGNIFICANT_Z
+                                    * sqrt(diff.variance() / diff.count);
+        rollout_horizon.update(horizon_context, changed);
+    }
+    return candidates[best];
+}
+
+/// @brief 使うカードと対象の山の組の列
+using UseCandidates = FixedVector<pair<int, int>, N_UB * M_UB>;
+
+/// @brief 使うカードと対象の山の候補. 明らかに劣るものは除く
+/// - 種類と労働力が同じカードは 1 枚だけ見る
+/// - WORK_ONE は, 価値が高く残りが低い側のパレート最適な山にだけ使う
+/// - DELETE_ONE は, 価値が低く残りが高い側のパレート最適な山にだけ使う
+/// - SCALE_UP は scale が上限なら使わない
+/// greedy (use_card_greedy の答え) を先頭に入れ,
+/// USE_SEARCH_MAX_ARMS 個で打ち切る
+UseCandidates use_card_candidates(const Hand& h, const Field& f,
+                                  int current_scale, pair<int, int> greedy) {
+    UseCandidates ret;
+    ret.push_back(greedy);
+    const auto& greedy_card = h.cards[greedy.first];
+    auto add                = [&](int pos, int mt) {
+        const auto& c = h.cards[pos];
+        if ((int)ret.size() >= USE_SEARCH_MAX_ARMS) return;
+        if (c.type == greedy_card.type
+            && c.work_amount == greedy_card.work_amount
+            && mt == greedy.second) {
+            return;
+        }
+        ret.push_back({pos, mt});
+    };
+    // 山 a が山 b より働く対象として良い (同じ山なら番号の小さい方)
+    auto better_work = [&](int a, int b) {
+        const auto& x = f.mountains[a];
+        const auto& y = f.mountains[b];
+        if (x.value == y.value && x.height == y.height) return a < b;
+        return x.value >= y.value && x.height <= y.height;
+    };
+    auto pareto = [&](auto&& better, int mt) {
+        for (int i = 0; i < f.m; ++i) {
+            if (i != mt && better(i, mt)) return false;
+        }
+        return true;
+    };
+    for (int i = 0; i < h.n; ++i) {
+        const auto& c   = h.cards[i];
+        bool duplicated = false;
+        for (int j = 0; j < i; ++j) {
+            duplicated |= h.cards[j].type == c.type
+                          && h.cards[j].work_amount == c.work_amount;
+        }
+        if (duplicated) continue;
+        switch (c.type) {
+            case WORK_ONE:
+                for (int mt = 0; mt < f.m; ++mt) {
+                    if (pareto(better_work, mt)) add(i, mt);
+                }
+                break;
+            case DELETE_ONE:
+                for (int mt = 0; mt < f.m; ++mt) {
+                    if (pareto([&](int a, int b) { return better_work(b, a); },
+                               mt)) {
+                        add(i, mt);
+                    }
+                }
+                break;
+            case SCALE_UP:
+                if (current_scale < 20) add(i, 0);
+                break;
+            default:
+                add(i, 0);
+        }
+    }
+    return ret;
+}
 
-    return candidates[ucb.best_arm()];
+GAME_LOCAL int64_t use_search_call_num = 0;
+/// @brief search_use_card の初期化にかかった時間 (候補 1 つあたり,
+/// マイクロ秒) の移動平均
+GAME_LOCAL double use_initial_us_per_candidate = 0;
+
+/// @brief 使うカードと対象の山をモンテカルロで選ぶ
+/// 候補ごとに Estimator::estimate_after_use でロールアウトし, pick_card と
+/// 同じ bandit で比べる. 山の補充とこのターンの補充候補はシナリオから決める
+pair<int, int> search_use_card(const Hand& h, const Field& f,
+                               const UseCandidates& candidates,
+                               int64_t current_money, int current_scale,
+                               int turn, int64_t freq[5],
+                               const scheduler::Deadline& deadline) {
+    PROBE_SCOPE("search_use_card");
+    assert(candidates.size() >= 2u);
+    use_search_call_num++;
+    const int arms = candidates.size();
+    // pick_card より 1 ターン手前から始めるので 1 ターン長く見る
+    const int turns = rollout_horizon.turns(
+        RolloutHorizon::context(turn, current_scale, false));
+    const int last_turn  = min(turn + 1 + turns, T);
+    const int sample_num = pick_card_sample_num();
+    scenario_pool.prepare(sample_num, turn, last_turn, freq);
+
+    auto rollout = [&](int arm, int round) {
+        return scenario_pool[round].estimate_after_use(
+            turn, last_turn, current_money, current_scale, h, f,
+            candidates[arm].first, candidates[arm].second);
+    };
+
+    BestArmIdentification bandit(arms, (BanditStrategy)BANDIT_STRATEGY,
+                                 EACH_FIRST_TRIES);
+    // initialize: 全候補を同じ round まで揃えて試し, 期限が来たら止める
+    // シナリオの生成は含めずに時間を測る
+    const int64_t initial_begin_us = deadline.elapsed_us();
+    int first_tries                = 0;
+    while (first_tries < EACH_FIRST_TRIES) {
+        for (int arm = 0; arm < arms; ++arm) {
+            bandit.update(arm, rollout(arm, first_tries));
+        }
+        first_tries++;
+        if (first_tries >= 2 && deadline.expired()) break;
+    }
+    const double initial_us_per_arm =
+        (double)(deadline.elapsed_us() - initial_begin_us) * EACH_FIRST_TRIES
+        / first_tries / arms;
+    use_initial_us_per_candidate =
+        use_initial_us_per_candidate == 0
+            ? initial_us_per_arm
+            : 0.9 * use_initial_us_per_candidate + 0.1 * initial_us_per_arm;
+
+    auto search_deadline =
+        deadline.sub_us(deadline.rest_us(), SEARCH_MAX_CHECK_INTERVAL);
+    const int sample_cap = search_sample_num(
+        search_deadline.rest_us(), arms, last_turn - turn, first_tries);
+    const int tries = search_tries(sample_cap, first_tries, arms);
+    bandit.start(tries, sample_cap);
+    const int64_t search_begin_us = deadline.elapsed_us();
+    const int search_begin_count  = bandit.ucb.total_count;
+    const double search_begin_sum = bandit.ucb.reward_sum();
+    const double ucb_c =
+        input::next_cards.k <= 2 ? UCB_C_WHEN_FEW_CARDS : UCB_C;
+    for (int i = 0; i < tries && search_deadline.alive(); ++i) {
+        PROBE_SCOPE("use_search_iteration");
+        const double c = (bandit.ucb.reward_sum() - search_begin_sum)
+                         / bandit.ucb.total_count * ucb_c;
+        const int arm =
+            bandit.select_arm(c, [] { return xorshift::getNormal(); });
+        if (arm < 0) {
+            break;
+        }
+        scenario_pool.extend(bandit.count(arm) + 1);
+        bandit.update(arm, rollout(arm, bandit.count(arm)));
+        if (bandit.check_early_stop()) {
+            PROBE_COUNT("use_search_early_stop");
+            break;
+        }
+    }
+    record_rollout_cost(deadline.elapsed_us() - search_begin_us,
+                        bandit.ucb.total_count - search_begin_count,
+                        last_turn - turn);
+    return candidates[bandit.best_arm()];
+}
+
+/// @brief このターンに使うカードと対象の山を決める
+/// 序盤・終盤は使うカードも補充と同じくらい所持金を左右するので,
+/// 時間があればモンテカルロで選ぶ
+pair<int, int> choose_use_card(const Hand& h, Field& f, int64_t current_money,
+                               int current_scale, int turn, int64_t freq[5],
+                               double mean_weight) {
+    const auto greedy = use_card_greedy(h, f, current_money, current_scale);
+    if (!JOINT_SEARCH || (turn > SETUP_TURN && turn < T - TEARDOWN_TURN)) {
+        return greedy;
+    }
+    const auto candidates = use_card_candidates(h, f, current_scale, greedy);
+    const double weight =
+        decision_weight(turn, candidates.size()) * USE_SEARCH_TIME_WEIGHT;
+    const auto deadline =
+        turn_budget.turn(weight, rest_decision_weight(turn, mean_weight));
+    if (weight <= 0
+        || deadline.rest_us()
+               < use_initial_us_per_candidate * candidates.size()) {
+        PROBE_COUNT("use_search_greedy_fallback");
+        return greedy;
+    }
+    return search_use_card(h, f, candidates, current_money, current_scale,
+                           turn, freq, deadline);
 }
 
 
@@ -767,8 +2198,19 @@ int run() {
     int64_t current_money = 0;
     int current_scale     = 0;
     int64_t freq[5]       = {0, 0, 0, 0, 0};
+    // 補充候補の選択の重みの平均 (序盤・終盤の倍率を除く)
+    // 補充候補がすべて候補に残る場合を事前の 1 回分として入れておく
+    double mean_weight = input::next_cards.k - 1;
+    int decision_num   = 1;
     // CardType last_used    = SCALE_UP;
     for (int turn = 0; turn < T; ++turn) {
+#ifdef BENCH
+        bench::stats().begin_turn();
+#endif
+#ifdef SPECULATIVE_SEARCH
+        // 前のターンに打ち切った裏の仕事がシナリオを触り終えるのを待つ
+        speculation().wait();
+#endif
         using namespace std::chrono;
         // auto now = high_resolution_clock::now();
         // Estimator estimator(turn, freq[0], freq[1], freq[2], freq[3],
@@ -780,38 +2222,24 @@ int run() {
         //      << ", " << current_scale << ", " << estimated_money << ")"
         //      << endl;
         auto [use_pos, mountain_pos] =
-            use_card_greedy(hand, field, current_money, current_scale);
+            choose_use_card(hand, field, current_money, current_scale, turn,
+                            freq, mean_weight);
         io::output_use_card(use_pos, mountain_pos);
-        if (0) switch (hand.cards[use_pos].type) {
-                case WORK_ONE:
-                    cout << "# decrease height " << mountain_pos << " "
-                         << field.mountains[mountain_pos].height << " -> "
-                         << field.mountains[mountain_pos].height
-                                - hand.cards[use_pos].work_amount
-                         << endl;
-                    break;
-                case WORK_ALL:
-                    cout << "# decrease height all "
-                         << hand.cards[use_pos].work_amount << endl;
-                    break;
-                case DELETE_ONE:
-                    cout << "# delete mountain " << mountain_pos << endl;
-                    break;
-                case DELETE_ALL:
-                    cout << "# delete all mountains" << endl;
-                    break;
-                case SCALE_UP:
-                    cout << "# scale up " << current_scale << " -> "
-                         << current_scale + 1 << endl;
-                    break;
-                default:
-                    assert(false);
-            }
+#ifdef BENCH
+        io::replay_use_card(use_pos, mountain_pos);
+#endif
         // last_used = hand.cards[use_pos].type;
         update_field(field, hand.cards[use_pos], mountain_pos, current_money,
                      current_scale);
         int64_t old_money = current_money;
+#ifdef SPECULATIVE_SEARCH
+        speculation().start(hand, use_pos, field, current_money,
+                            current_scale, turn, freq);
+#endif
         io::input_next(current_money, field, next_cards);
+#ifdef SPECULATIVE_SEARCH
+        speculation().cancel();
+#endif
         if (old_money != current_money) {
             cerr << "current_money = " << current_money << endl;
             cerr << "old_money = " << old_money << endl;
@@ -820,33 +2248,37 @@ int run() {
         for (int i = 0; i < next_cards.k; ++i) {
             freq[next_cards.cards[i].type]++;
         }
-        const auto current_elapsed =
-            duration_cast<milliseconds>(high_resolution_clock::now()
-                                        - start_time)
-                .count();
-
-        bool do_full_search =
-            (current_elapsed < TIME_LIMIT_MS - 10)
-            && (turn <= SETUP_TURN || turn >= T - TEARDOWN_TURN);
-        if (!do_full_search && current_elapsed < TIME_LIMIT_MS - 20) {
-            if (pick_card_call_num == 0) pick_card_call_num = 1;
-            avg_ms_pick_card = total_ms_pick_card / (double)pick_card_call_num;
-            if (avg_ms_pick_card < 1) avg_ms_pick_card = 1;
-            auto rest_call_num =
-                (TIME_LIMIT_MS - 10 - current_elapsed) / avg_ms_pick_card
-                - TEARDOWN_TURN;
-            double prob    = rest_call_num / (T - TEARDOWN_TURN - turn);
-            do_full_search = xorshift::getDouble() < prob;
-        }
+        bool full_search = false;
         if (turn < T - 1) {
+            const auto candidates =
+                filter_next_cards(next_cards, current_money, current_scale);
+            const double weight = decision_weight(turn, candidates.size());
+            mean_weight += (max(0, (int)candidates.size() - 1) - mean_weight)
+                           / ++decision_num;
+            // 配られた時間で初期化フェーズを終えられないなら貪欲に選ぶ
+            const auto deadline = turn_budget.turn(
+                weight, rest_decision_weight(turn, mean_weight));
+            full_search =
+                weight > 0
+                && deadline.rest_us()
+                       >= initial_us_per_candidate * candidates.size();
+            if (!full_search) PROBE_COUNT("pick_card_greedy_fallback");
+#ifdef SPECULATIVE_SEARCH
+            // 貪欲に選ぶなら裏の仕事が止まるのを待たない
+            if (full_search) speculation().wait();
+#endif
             auto pick_pos =
-                do_full_search
-                    ? pick_card(hand, use_pos, field, next_cards, current_money,
-                                current_scale, turn, freq)
-                    : pick_card_greedy(hand, next_cards, current_money,
+                full_search
+                    ? pick_card(hand, use_pos, field, next_cards, candidates,
+                                current_money, current_scale, turn, freq,
+                                deadline)
+                    : pick_card_greedy(next_cards, current_money,
                                        current_scale, turn);
 
             io::output_pick_card(next_cards.cards[pick_pos].id);
+#ifdef BENCH
+            pick_pos = io::replay_pick_card(next_cards);
+#endif
             current_money -= next_cards.cards[pick_pos].cost;
             int old_id             = hand.cards[use_pos].id;
             hand.cards[use_pos]    = next_cards.cards[pick_pos];
@@ -860,6 +2292,14 @@ int run() {
         //      - now)
         //             .count()
         //      << endl;
+        // ターンごとの系列 (提出用のビルドでは何もしない)
+        logger::push("money", turn, current_money);
+        logger::push("scale", turn, current_scale);
+        logger::push("full_search", turn, full_search);
+        logger::push("rollouts", turn, rollout_counter.take());
+#ifdef BENCH
+        bench::stats().end_turn();
+#endif
     }
     double freq_tot = freq[0] + freq[1] + freq[2] + freq[3] + freq[4];
     logger::push("prob(0)", freq[0] / freq_tot);
@@ -870,20 +2310,158 @@ int run() {
     return current_money;
 }
 
+#ifdef BATCH_JUDGE
+/// @brief 試合ごとの状態を初期値に戻す. スレッドで次の試合を始める前に呼ぶ
+/// 持ち時間は起動時からではなく, 試合を始める今から測る
+void reset_game_state(int time_limit_ms) {
+    scenario_pool                = ScenarioPool();
+    total_us_pick_card           = 0;
+    pick_card_call_num           = 0;
+    avg_ms_pick_card             = 1;
+    initial_us_per_candidate     = 0;
+    us_per_rollout_turn          = 0;
+    rollout_horizon              = RolloutHorizon();
+    use_search_call_num          = 0;
+    use_initial_us_per_candidate = 0;
+    turn_budget =
+        scheduler::TurnBudget::starting_now(time_limit_ms - TIME_MARGIN_MS);
+    xorshift::set_seed(xorshift::DEFAULT_SEED);
+    logger::clear();
+#ifdef PROBE
+    probe::reset();
+#endif
+}
+
+/// @brief seed が [BG, ED] の試合をプロセス内のジャッジで並行に進める
+/// (make batch). 試合ごとに LOG_DIR/{seed:04d}.txt へ logger の出力と
+/// util.extract_score_from_file が読む "Score = " の行を書く
+/// TIME_LIMIT_MS を与えると 1 試合の持ち時間を変えられる (手早く回す用)
+int main(int argc, char* argv[]) {
+    if (argc < 4) {
+        cerr << "usage: " << argv[0]
+             << " BG ED LOG_DIR [THREADS] [TIME_LIMIT_MS]" << endl;
+        return 1;
+    }
+#ifdef TUNING
+    // 上書きした名前はすべて定数の初期化 (main の前) で読まれているはず
+    params::check_unused();
+#endif
+    const int bg         = stoi(argv[1]);
+    const int ed         = stoi(argv[2]);
+    const string log_dir = argv[3];
+    const int threads =
+        argc >= 5 ? stoi(argv[4]) : thread_pool::hardware_threads();
+    const int time_limit = argc >= 6 ? stoi(argv[5]) : TIME_LIMIT_MS;
+    const int game_num   = max(0, ed - bg + 1);
+    vector<int64_t> scores(game_num);
+
+    thread_pool::ThreadPool pool(threads, [](int) {});
+    pool.parallel_for(game_num, [&](int task_id, int) {
+        const int seed = bg + task_id;
+        judge::Game game(seed);
+        judge::current() = &game;
+        reset_game_state(time_limit);
+
+        using namespace input;
+        io::input_first(hand, field, next_cards);
+        rollout_kernel::select(hand.n, field.m, next_cards.k);
+        const int64_t score = run();
+        assert(game.finished() && game.money == score);
+
+        logger::push("time", turn_budget.global.elapsed_us() / 1000);
+        logger::push("full_search_called", pick_card_call_num);
+        logger::push("use_search_called", use_search_call_num);
+        logger::push("score", score);
+#ifdef PROBE
+        probe::report();
+#endif
+        char name[16];
+        snprintf(name, sizeof(name), "/%04d.txt", seed);
+        ofstream(log_dir + name)
+            << logger::format() << "Score = " << game.money << "\n";
+        scores[task_id] = game.money;
+        judge::current() = nullptr;
+    });
+
+    // run_local.py と同じく log2 (スコア) の平均を出す
+    double log_sum = 0;
+    for (int64_t score : scores) log_sum += log2(max<int64_t>(score, 1));
+    cout << "Games: " << game_num << endl;
+    if (game_num > 0) cout << "Average: " << log_sum / game_num << endl;
+    return 0;
+}
+#elif defined(BENCH)
+/// @brief 記録した対戦 argv[1] を再生して探索の速さを測る (make bench)
+/// 探索はそのまま行うが手は記録どおりに指すので, 入力は記録と一致する
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        cerr << "usage: " << argv[0] << " TRANSCRIPT [SEED]" << endl;
+        return 1;
+    }
+    fast_io::in.fd = open(argv[1], O_RDONLY);
+    if (fast_io::in.fd < 0) {
+        cerr << "cannot open " << argv[1] << endl;
+        return 1;
+    }
+    fast_io::out.fd = -1; // 手は出力しない
+    xorshift::set_seed(argc >= 3 ? stoull(argv[2]) : xorshift::DEFAULT_SEED);
+
+    using namespace input;
+    io::input_first(hand, field, next_cards);
+    rollout_kernel::select(hand.n, field.m, next_cards.k);
+
+    int64_t score = run();
+
+    bench::stats().report();
+    logger::push("full_search_called", pick_card_call_num);
+    logger::push("use_search_called", use_search_call_num);
+    logger::push("score", score);
+#ifdef PROBE
+    probe::report();
+#endif
+    logger::flush();
+    return 0;
+}
+#elif !defined(EXTERNAL_MAIN) // main は sampler_check.cpp などが持つ
 int main() {
-    using namespace std::chrono;
+#ifdef TUNING
+    // 上書きした名前はすべて定数の初期化 (main の前) で読まれているはず
+    params::check_unused();
+#endif
     using namespace input;
-    start_time = high_resolution_clock::now();
+#ifdef RECORD_TRANSCRIPT
+    // 環境変数 TRANSCRIPT のファイルに, 受け取った入力と出した手を
+    // やり取りの順にそのまま書き写す (make bench で再生する)
+    if (const char* path = getenv("TRANSCRIPT")) {
+        const int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        fast_io::in.copy_fd  = fd;
+        fast_io::out.copy_fd = fd;
+    }
+#endif
     io::input_first(hand, field, next_cards);
+    rollout_kernel::select(hand.n, field.m, next_cards.k);
 
     int64_t score = run();
+    io::flush();
 
-    int64_t elapsed =
-        duration_cast<milliseconds>(high_resolution_clock::now() - start_time)
-            .count();
+    // 経過時間は時計の較正時 (起動時) から測る
+    int64_t elapsed = scheduler::clock().elapsed_us() / 1000;
     logger::push("time", elapsed);
     logger::push("full_search_called", pick_card_call_num);
+    logger::push("use_search_called", use_search_call_num);
+#ifdef SPECULATIVE_SEARCH
+    logger::push("speculation_reused", speculation().reused_num);
+#endif
+    logger::push("scenario_refresh", scenario_pool.refresh_num);
+    // 文脈ごとの最後のターン数 (一度も使わなかった文脈は 0)
+    for (int i = 0; i < RolloutHorizon::CONTEXTS; ++i) {
+        logger::push("horizon", i, rollout_horizon.turns_[i]);
+    }
     logger::push("score", score);
+#ifdef PROBE
+    probe::report();
+#endif
     logger::flush();
     return 0;
 }
+#endif
@@ -0,0 +1,175 @@
+// 表を引く InputGenerator の分布を確かめる (make sampler-check)
+// InputGenerator などは main.cpp のものを使うので, main を除いて取り込む
+#define EXTERNAL_MAIN
+#include "main.cpp"
+
+/// @brief 表を引く前の生成方法 (種類は重みを順に引いて選び, 正規分布は
+/// 1 枚ごとに Box-Muller で引いて丸める). InputGenerator とは別の
+/// 乱数の系列を使う
+struct ReferenceGenerator {
+    xorshift::Xoshiro256 rng;
+    double w[CARD_TYPE_NUM];
+
+    ReferenceGenerator(const double weights[CARD_TYPE_NUM])
+        : rng(xorshift::DEFAULT_SEED + 1) {
+        double sum = 0;
+        for (int t = 0; t < CARD_TYPE_NUM; ++t) sum += weights[t];
+        for (int t = 0; t < CARD_TYPE_NUM; ++t) w[t] = weights[t] / sum;
+    }
+
+    inline double uniform() { return xorshift::to_double(rng.gen()); }
+    inline int64_t rand_int(int64_t l, int64_t r) {
+        return l + rng.gen() % (r - l + 1);
+    }
+    inline double gauss(double mu, double sigma) {
+        // log(0) を避けるため (0, 1] にする
+        const double u = 1.0 - uniform();
+        return mu + sigma * sqrt(-2.0 * log(u)) * sin(2.0 * M_PI * uniform());
+    }
+
+    Mountain generate_mountain() {
+        const double b = 2.0 + 6.0 * uniform();
+        return {llround(exp2(b)),
+                llround(exp2(clamp_double(gauss(b, 0.5), 0.0, 10.0)))};
+    }
+
+    C generate_card(int m) {
+        double r = uniform();
+        int type = 0;
+        while (type + 1 < CARD_TYPE_NUM && r >= w[type]) r -= w[type++];
+        C ret;
+        ret.type = CardType(type);
+        switch (type) {
+            case WORK_ONE: {
+                const int64_t w_dash = rand_int(1, 50);
+                ret.work_amount      = w_dash;
+                ret.cost =
+                    clamp(llround(gauss(w_dash, w_dash / 3.0)), 1, 10000);
+                break;
+            }
+            case WORK_ALL: {
+                const int64_t w_dash = rand_int(1, 50);
+                ret.work_amount      = w_dash;
+                ret.cost             = clamp(
+                    llround(gauss(w_dash * m, w_dash * m / 3.0)), 1, 10000);
+                break;
+            }
+            case DELETE_ONE:
+            case DELETE_ALL:
+                ret.work_amount = 0;
+                ret.cost        = rand_int(0, 10);
+                break;
+            default:
+                ret.work_amount = 0;
+                ret.cost        = rand_int(200, 1000);
+        }
+        return ret;
+    }
+};
+
+/// @brief 標本の平均と分散. 分散の標準誤差に 4 次の中心モーメントを使う
+struct Moments {
+    vector<double> xs;
+
+    void add(double x) { xs.push_back(x); }
+    double mean() const {
+        double s = 0;
+        for (double x : xs) s += x;
+        return s / xs.size();
+    }
+    double var() const {
+        const double mu = mean();
+        double s        = 0;
+        for (double x : xs) s += (x - mu) * (x - mu);
+        return s / xs.size();
+    }
+    /// 平均の標準誤差の 2 乗
+    double mean_se2() const { return var() / xs.size(); }
+    /// 分散の標準誤差の 2 乗 ((m4 - var^2) / n)
+    double var_se2() const {
+        const double mu = mean();
+        const double v  = var();
+        double m4       = 0;
+        for (double x : xs) m4 += pow(x - mu, 4);
+        m4 /= xs.size();
+        return max(m4 - v * v, 1e-12) / xs.size();
+    }
+};
+
+/// @brief 表を引く InputGenerator と ReferenceGenerator の分布を比べる
+/// (make sampler-check). 種類の頻度, 種類ごとのコストの平均と標準偏差,
+/// 山の高さと価値の平均と標準偏差を比べ, 差が標準誤差の Z 倍を超えたら
+/// その項目を書いて 1 を返す
+int main(int argc, char* argv[]) {
+    const int draws    = argc >= 2 ? stoi(argv[1]) : 1 << 20;
+    const double max_z = argc >= 3 ? stod(argv[2]) : 5.0;
+    // (重み, m) の組. 重みは試合の重みの範囲 [1, WEIGHT_MAX] から選ぶ
+    const vector<pair<array<double, CARD_TYPE_NUM>, int>> cases = {
+        {{1, 1, 1, 1, 1}, M_LB},
+        {{20, 10, 10, 5, 3}, M_UB},
+        {{3, 9, 1, 4, 1}, 5},
+        {{17, 1, 6, 1, 2}, 3},
+    };
+
+    int failed   = 0;
+    int compared = 0;
+    auto check   = [&](const string& name, double a, double b, double se2) {
+        const double z = fabs(a - b) / sqrt(max(se2, 1e-300));
+        compared++;
+        if (z <= max_z) return;
+        failed++;
+        cout << "NG " << name << ": table " << a << ", reference " << b
+             << " (z = " << z << ")" << endl;
+    };
+    auto check_moments = [&](const string& name, const Moments& a,
+                             const Moments& b) {
+        check(name + " mean", a.mean(), b.mean(),
+              a.mean_se2() + b.mean_se2());
+        check(name + " sd", sqrt(a.var()), sqrt(b.var()),
+              // sd の標準誤差は var の標準誤差 / (2 sd) で近似する
+              (a.var_se2() + b.var_se2()) / (4 * max(a.var(), 1e-12)));
+    };
+
+    for (const auto& [weights, m] : cases) {
+        string label = "w=";
+        for (double x : weights) label += to_string(int(x)) + ",";
+        label += " m=" + to_string(m);
+        input::field.m = m;
+
+        InputGenerator table;
+        table.set_weights(weights.data());
+        ReferenceGenerator reference(weights.data());
+
+        Moments cost[2][CARD_TYPE_NUM], height[2], value[2];
+        int64_t type_count[2][CARD_TYPE_NUM] = {};
+        for (int i = 0; i < draws; ++i) {
+            const C a = table.generate_card(0, m);
+            const C b = reference.generate_card(m);
+            type_count[0][a.type]++;
+            type_count[1][b.type]++;
+            cost[0][a.type].add(a.cost);
+            cost[1][b.type].add(b.cost);
+            const Mountain ma = table.generate_mountain(0);
+            const Mountain mb = reference.generate_mountain();
+            height[0].add(ma.height);
+            height[1].add(mb.height);
+            value[0].add(ma.value);
+            value[1].add(mb.value);
+        }
+
+        for (int t = 0; t < CARD_TYPE_NUM; ++t) {
+            const string name = label + " type " + to_string(t);
+            const double pa   = type_count[0][t] / double(draws);
+            const double pb   = type_count[1][t] / double(draws);
+            const double p    = (pa + pb) / 2;
+            check(name + " freq", pa, pb, 2 * p * (1 - p) / draws);
+            if (cost[0][t].xs.size() < 2 || cost[1][t].xs.size() < 2) continue;
+            check_moments(name + " cost", cost[0][t], cost[1][t]);
+        }
+        check_moments(label + " height", height[0], height[1]);
+        check_moments(label + " value", value[0], value[1]);
+    }
+
+    cout << "Compared: " << compared << ", failed: " << failed << endl;
+    return failed ? 1 : 0;
+}